@@ -24,4 +24,5 @@ namespace globals {
 
 	inline const double BEND_GLIDE_MS = 2;
 	inline const double REPEAT_NOTE_FADE_MS = 1;
+	inline const unsigned int NOISE_SEED = 0x52505831; // base seed of voices noise in deterministic mode
 };
\ No newline at end of file
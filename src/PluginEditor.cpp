@@ -212,10 +212,7 @@ RipplerXAudioProcessorEditor::RipplerXAudioProcessorEditor(RipplerXAudioProcesso
                         if (file == juce::File{})
                             return;
 
-                        juce::MemoryBlock mb;
-                        processor.getStateInformation(mb);
-
-                        if (auto xml = audioProcessor.getXmlFromBinary(mb.getData(), (int)mb.getSize())) {
+                        if (auto xml = audioProcessor.getStateXml()) {
                             juce::String xmlString = xml->toString();
                             file.replaceWithText(xmlString.toStdString());
                         }
@@ -971,6 +968,11 @@ void RipplerXAudioProcessorEditor::showSettingsMenu()
     bool stereoizer = (bool)audioProcessor.params.getRawParameterValue("stereoizer")->load();
     bool reuseVoices = (bool)audioProcessor.params.getRawParameterValue("reuse_voices")->load();
     bool fadeoutRepeats = (bool)audioProcessor.params.getRawParameterValue("fadeout_repeats")->load();
+    bool sharedCut = (bool)audioProcessor.params.getRawParameterValue("shared_cut")->load();
+    bool limiterLookahead = audioProcessor.limiterLookahead;
+    bool harmonicTubes = (bool)audioProcessor.params.getRawParameterValue("harmonic_tubes")->load();
+    bool multirate = audioProcessor.multiratePartials;
+    bool fixedRate = audioProcessor.fixedRate;
 
     PopupMenu menu;
     PopupMenu scaleMenu;
@@ -987,11 +989,16 @@ void RipplerXAudioProcessorEditor::showSettingsMenu()
     menu.addSubMenu("UI Scale", scaleMenu);
     menu.addSubMenu("Polyphony", polyphonyMenu);
     menu.addItem(11, "Stereoizer", true, stereoizer);
+    menu.addItem(13, "Shared cut filter", true, sharedCut);
+    menu.addItem(14, "Limiter lookahead", true, limiterLookahead);
+    menu.addItem(15, "Render harmonic models as waveguides", true, harmonicTubes);
+    menu.addItem(16, "Multirate partials", true, multirate);
+    menu.addItem(17, "Fixed engine rate (44.1/48kHz)", true, fixedRate);
 
     auto menuPos = localPointToGlobal(settingsBtn.getBounds().getBottomRight());
     menu.showMenuAsync(PopupMenu::Options()
         .withTargetScreenArea({ menuPos.getX() - 125, menuPos.getY(), 1, 1 }),
-        [this, stereoizer, reuseVoices, fadeoutRepeats](int result) {
+        [this, stereoizer, reuseVoices, fadeoutRepeats, sharedCut, limiterLookahead, harmonicTubes, multirate, fixedRate](int result) {
             if (result == 0) return;
             if (result == 1) audioProcessor.setScale(1.f);
             if (result == 2) audioProcessor.setScale(1.25f);
@@ -1014,6 +1021,23 @@ void RipplerXAudioProcessorEditor::showSettingsMenu()
                 auto param = audioProcessor.params.getParameter("fadeout_repeats");
                 param->setValueNotifyingHost(fadeoutRepeats ? 0.f : 1.f);
             }
+            if (result == 13) {
+                auto param = audioProcessor.params.getParameter("shared_cut");
+                param->setValueNotifyingHost(sharedCut ? 0.f : 1.f);
+            }
+            if (result == 14) {
+                audioProcessor.setLimiterLookahead(!limiterLookahead);
+            }
+            if (result == 15) {
+                auto param = audioProcessor.params.getParameter("harmonic_tubes");
+                param->setValueNotifyingHost(harmonicTubes ? 0.f : 1.f);
+            }
+            if (result == 16) {
+                audioProcessor.setMultiratePartials(!multirate);
+            }
+            if (result == 17) {
+                audioProcessor.setFixedRate(!fixedRate);
+            }
         });
 }
 
@@ -1059,7 +1083,7 @@ void RipplerXAudioProcessorEditor::showMalletMenu()
 
                         auto path = file.getFullPathName();
                         MessageManager::callAsync([this, path, param]() {
-                            audioProcessor.malletSampler->loadSample(path);
+                            audioProcessor.loadMalletSample(path);
                             param->setValueNotifyingHost(param->convertTo0to1(float(kUserFile)));
                         });
                     });
@@ -4,6 +4,10 @@
 #include "PluginEditor.h"
 #include "Globals.h"
 
+// binary state header, states without it are read as legacy xml
+static constexpr int BINARY_STATE_MAGIC = 0x31585052; // "RPX1"
+static constexpr int BINARY_STATE_VERSION = 1;
+
 RipplerXAudioProcessor::RipplerXAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
     : AudioProcessor(BusesProperties()
@@ -94,6 +98,8 @@ RipplerXAudioProcessor::RipplerXAudioProcessor()
         std::make_unique<juce::AudioParameterBool>("stereoizer", "Stereoizer", true),
         std::make_unique<juce::AudioParameterBool>("reuse_voices", "Reuse Voices", false),
         std::make_unique<juce::AudioParameterBool>("fadeout_repeats", "Fadeout Repeated Notes", false),
+        std::make_unique<juce::AudioParameterBool>("shared_cut", "Shared Cut Filter", false),
+        std::make_unique<juce::AudioParameterBool>("harmonic_tubes", "Harmonic Models As Waveguides", false),
     }),
     mtsClientPtr{nullptr}
 #endif
@@ -113,15 +119,19 @@ RipplerXAudioProcessor::RipplerXAudioProcessor()
     }
 
     models = std::make_unique<Models>();
+    presets = std::make_unique<Presets>(params);
     malletSampler = std::make_unique<Sampler>();
 
+    voices.reserve(globals::MAX_POLYPHONY);
     for (int i = 0; i < globals::MAX_POLYPHONY; ++i) {
-        voices.push_back(std::make_unique<Voice>(*models, *malletSampler));
+        voices.emplace_back(*models, *malletSampler);
     }
+    allocateTubes(44100.0);
     
     mtsClientPtr = MTS_RegisterClient();
     
     loadSettings();
+    numVoices = polyphony;
 }
 
 void RipplerXAudioProcessor::parameterValueChanged (int parameterIndex, float newValue)
@@ -129,6 +139,7 @@ void RipplerXAudioProcessor::parameterValueChanged (int parameterIndex, float ne
     (void)parameterIndex; // suppress unused warnings
     (void)newValue;
     paramChanged = true;
+    stateChanged = true;
 }
 
 void RipplerXAudioProcessor::parameterGestureChanged (int parameterIndex, bool gestureIsStarting)
@@ -140,6 +151,12 @@ void RipplerXAudioProcessor::parameterGestureChanged (int parameterIndex, bool g
 RipplerXAudioProcessor::~RipplerXAudioProcessor()
 {
     MTS_DeregisterClient(mtsClientPtr);
+
+    Command command;
+    while (commands.pop(command))
+        delete command.sampler;
+    while (commandResults.pop(command))
+        delete command.sampler;
 }
 
 void RipplerXAudioProcessor::loadSettings ()
@@ -148,6 +165,9 @@ void RipplerXAudioProcessor::loadSettings ()
         scale = (float)file->getDoubleValue("scale", 1.0f);
         polyphony = file->getIntValue("polyphony", 8);
         darkTheme = file->getBoolValue("dark-theme", false);
+        limiterLookahead = file->getBoolValue("limiter-lookahead", false);
+        multiratePartials = file->getBoolValue("multirate-partials", false);
+        fixedRate = file->getBoolValue("fixed-rate", false);
     }
 }
 
@@ -157,6 +177,9 @@ void RipplerXAudioProcessor::saveSettings ()
         file->setValue("scale", scale);
         file->setValue("polyphony", polyphony);
         file->setValue("dark-theme", darkTheme);
+        file->setValue("limiter-lookahead", limiterLookahead);
+        file->setValue("multirate-partials", multiratePartials);
+        file->setValue("fixed-rate", fixedRate);
     }
     settings.saveIfNeeded();
 }
@@ -165,8 +188,47 @@ void RipplerXAudioProcessor::setPolyphony(int value)
 {
     polyphony = value;
     saveSettings();
-    clearVoices();
-    onSlider();
+    pushCommand({ CommandType::SetPolyphony, value, nullptr });
+}
+
+// Sends a command to the audio thread, called from the message thread or a host thread setting the state
+// also frees the data of commands already processed, the lock keeps a single producer on the queues
+void RipplerXAudioProcessor::pushCommand(Command command)
+{
+    const juce::ScopedLock lock(commandLock);
+    Command result;
+    while (commandResults.pop(result))
+        delete result.sampler;
+
+    if (!commands.push(command)) {
+        jassertfalse; // queue full, audio thread is not running
+        delete command.sampler;
+    }
+}
+
+// Applies the commands sent by the message thread, called from the audio thread
+void RipplerXAudioProcessor::processCommands()
+{
+    Command command;
+    while (commands.pop(command)) {
+        if (command.type == CommandType::SetPolyphony) {
+            numVoices = command.value;
+            clearVoices();
+            paramChanged = true; // update the new voices params
+        }
+        else if (command.type == CommandType::ClearVoices) {
+            clearVoices();
+        }
+        else if (command.type == CommandType::ResetLastModels) {
+            resetLastModels();
+        }
+        else if (command.type == CommandType::SwapSample) {
+            malletSampler->swap(*command.sampler);
+            if (!commandResults.push(command)) {
+                jassertfalse; // results are not being collected, leak instead of freeing on the audio thread
+            }
+        }
+    }
 }
 
 // Set UI scale factor
@@ -182,6 +244,38 @@ void RipplerXAudioProcessor::toggleTheme()
     saveSettings();
 }
 
+void RipplerXAudioProcessor::setLimiterLookahead(bool value)
+{
+    limiterLookahead = value;
+    saveSettings();
+    prepareAgain();
+}
+
+void RipplerXAudioProcessor::setMultiratePartials(bool value)
+{
+    multiratePartials = value;
+    saveSettings();
+    prepareAgain();
+}
+
+void RipplerXAudioProcessor::setFixedRate(bool value)
+{
+    fixedRate = value;
+    saveSettings();
+    prepareAgain();
+}
+
+// applies the settings that change the latency or the engine rate, called from the message thread
+// the audio thread is suspended while the engine is prepared again with the current rate and block size
+void RipplerXAudioProcessor::prepareAgain()
+{
+    if (getSampleRate() <= 0.0)
+        return; // not prepared yet, prepareToPlay applies the settings
+    suspendProcessing(true);
+    prepareToPlay(getSampleRate(), blockSize);
+    suspendProcessing(false);
+}
+
 //==============================================================================
 const juce::String RipplerXAudioProcessor::getName() const
 {
@@ -215,14 +309,35 @@ bool RipplerXAudioProcessor::isMidiEffect() const
    #endif
 }
 
+// longest release of the current settings, the resonators decay 60dB in about 1.1x their decay time
 double RipplerXAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    auto resonatorTail = [this](const char* on, const char* decay, const char* vel_decay, const char* rel)
+        {
+            if (!(bool)params.getRawParameterValue(on)->load())
+                return 0.0;
+            auto decay_k = (double)params.getRawParameterValue(decay)->load();
+            auto vel = (double)params.getRawParameterValue(vel_decay)->load();
+            if (vel > 0.0) // full velocity gives the longest decay
+                decay_k = exp(log(decay_k) + vel * (log(100.0) - log(0.01)));
+            decay_k = fmax(0.01, fmin(100.0, decay_k));
+            return 1.1 * decay_k * (double)params.getRawParameterValue(rel)->load();
+        };
+
+    auto noise_rel = (double)params.getRawParameterValue("noise_rel")->load();
+    auto vel_noise_rel = (double)params.getRawParameterValue("vel_noise_rel")->load();
+    if (vel_noise_rel > 0.0)
+        noise_rel = fmin(20000.0, exp(log(noise_rel) + vel_noise_rel * (log(20000.0) - log(1.0))));
+
+    auto tail = fmax(resonatorTail("a_on", "a_decay", "vel_a_decay", "a_rel"),
+        resonatorTail("b_on", "b_decay", "vel_b_decay", "b_rel"));
+
+    return noise_rel / 1000.0 + tail + delaySeconds;
 }
 
 int RipplerXAudioProcessor::getNumPrograms()
 {
-    return 28;
+    return Presets::NUM_PRESETS;
 }
 
 int RipplerXAudioProcessor::getCurrentProgram()
@@ -234,99 +349,21 @@ void RipplerXAudioProcessor::setCurrentProgram (int index)
 {
     if (currentProgram == index) return;
     currentProgram = index;
-    auto data = BinaryData::Init_xml;
-    auto size = BinaryData::Init_xmlSize;
+    stateChanged = true;
     if (currentProgram == -1) return;
 
-    if (index == 1) { data = BinaryData::Harpsi_xml; size = BinaryData::Harpsi_xmlSize; }
-    else if (index == 2) { data = BinaryData::Harp_xml; size = BinaryData::Harp_xmlSize; }
-    else if (index == 3) { data = BinaryData::Sankyo_xml; size = BinaryData::Sankyo_xmlSize; }
-    else if (index == 4) { data = BinaryData::Tubes_xml; size = BinaryData::Tubes_xmlSize; }
-    else if (index == 5) { data = BinaryData::Stars_xml; size = BinaryData::Stars_xmlSize; }
-    else if (index == 6) { data = BinaryData::DoorBell_xml; size = BinaryData::DoorBell_xmlSize; }
-    else if (index == 7) { data = BinaryData::Bells_xml; size = BinaryData::Bells_xmlSize; }
-    else if (index == 8) { data = BinaryData::Bells2_xml; size = BinaryData::Bells2_xmlSize; }
-    else if (index == 9) { data = BinaryData::KeyRing_xml; size = BinaryData::KeyRing_xmlSize; }
-    else if (index == 10) { data = BinaryData::Sink_xml; size = BinaryData::Sink_xmlSize; }
-    else if (index == 11) { data = BinaryData::Cans_xml; size = BinaryData::Cans_xmlSize; }
-    else if (index == 12) { data = BinaryData::Gong_xml; size = BinaryData::Gong_xmlSize; }
-    else if (index == 13) { data = BinaryData::Bong_xml; size = BinaryData::Bong_xmlSize; }
-    else if (index == 14) { data = BinaryData::Marimba_xml; size = BinaryData::Marimba_xmlSize; }
-    else if (index == 15) { data = BinaryData::Fight_xml; size = BinaryData::Fight_xmlSize; }
-    else if (index == 16) { data = BinaryData::Tabla_xml; size = BinaryData::Tabla_xmlSize; }
-    else if (index == 17) { data = BinaryData::Tabla2_xml; size = BinaryData::Tabla2_xmlSize; }
-    else if (index == 18) { data = BinaryData::Strings_xml; size = BinaryData::Strings_xmlSize; }
-    else if (index == 19) { data = BinaryData::OldClock_xml; size = BinaryData::OldClock_xmlSize; }
-    else if (index == 20) { data = BinaryData::Crystal_xml; size = BinaryData::Crystal_xmlSize; }
-    else if (index == 21) { data = BinaryData::Ride_xml; size = BinaryData::Ride_xmlSize; }
-    else if (index == 22) { data = BinaryData::Ride2_xml; size = BinaryData::Ride2_xmlSize; }
-    else if (index == 23) { data = BinaryData::Crash_xml; size = BinaryData::Crash_xmlSize; }
-    else if (index == 24) { data = BinaryData::Vibes_xml; size = BinaryData::Vibes_xmlSize; }
-    else if (index == 25) { data = BinaryData::Flute_xml; size = BinaryData::Flute_xmlSize; }
-    else if (index == 26) { data = BinaryData::Fifths_xml; size = BinaryData::Fifths_xmlSize; }
-    else if (index == 27) { data = BinaryData::Kalimba_xml; size = BinaryData::Kalimba_xmlSize; }
-
-    auto xmlState = XmlDocument::parse (juce::String (data, size));
-    if (xmlState.get() != nullptr) {
-        if (xmlState->hasTagName(params.state.getType())) {
-            clearVoices();
-            auto state = juce::ValueTree::fromXml(*xmlState);
-
-            // migrate a_cut and b_cut to new normalized range
-            auto a_cut = state.getChildWithProperty("id", "a_cut");
-            if (a_cut.isValid()) {
-                float val = (float)a_cut.getProperty("value");
-                if (val >= 20.0f) {
-                    val = std::log(val / 20.0f) / std::log(20000.0f / 20.0f);
-                    a_cut.setProperty("value", val, nullptr);
-                }
-            }
-            auto b_cut = state.getChildWithProperty("id", "b_cut");
-            if (b_cut.isValid()) {
-                float val = (float)b_cut.getProperty("value");
-                if (val >= 20.0f) {
-                    val = std::log(val / 20.0f) / std::log(20000.0f / 20.0f);
-                    b_cut.setProperty("value", val, nullptr);
-                }
-            }
-
-            params.replaceState(state);
-            resetLastModels();
-        }
+    // the params and the flag are written under the lock, the audio thread
+    // only runs onSlider() once the whole program is written
+    const juce::ScopedLock lock(programLock);
+    if (presets->apply(index)) {
+        programChanged = true;
+        pushCommand({ CommandType::ResetLastModels, 0, nullptr });
     }
 }
 
 const juce::String RipplerXAudioProcessor::getProgramName (int index)
 {
-    if (index == 0) return "Init";
-    if (index == 1) return "Harpsi";
-    if (index == 2) return "Harp";
-    if (index == 3) return "Sankyo";
-    if (index == 4) return "Tubes";
-    if (index == 5) return "Stars";
-    if (index == 6) return "DoorBell";
-    if (index == 7) return "Bells";
-    if (index == 8) return "Bells2";
-    if (index == 9) return "KeyRing";
-    if (index == 10) return "Sink";
-    if (index == 11) return "Cans";
-    if (index == 12) return "Gong";
-    if (index == 13) return "Bong";
-    if (index == 14) return "Marimba";
-    if (index == 15) return "Fight";
-    if (index == 16) return "Tabla";
-    if (index == 17) return "Tabla2";
-    if (index == 18) return "Strings";
-    if (index == 19) return "OldClock";
-    if (index == 20) return "Crystal";
-    if (index == 21) return "Ride";
-    if (index == 22) return "Ride2";
-    if (index == 23) return "Crash";
-    if (index == 24) return "Vibes";
-    if (index == 25) return "Flute";
-    if (index == 26) return "Fifths";
-    if (index == 27) return "Kalimba";
-    return "";
+    return Presets::getName(index);
 }
 
 void RipplerXAudioProcessor::changeProgramName (int index, const juce::String& newName)
@@ -338,14 +375,36 @@ void RipplerXAudioProcessor::changeProgramName (int index, const juce::String& n
 //==============================================================================
 void RipplerXAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    (void)samplesPerBlock;
-    totalSamplesBend = (int)(globals::BEND_GLIDE_MS * 0.001 * sampleRate);
-    Partial::initA1LUT(sampleRate);
-    comb.init(sampleRate);
-    limiter.init(sampleRate);
+    Partial::initA1LUT();
+    Kernels::select();
+    allocateTubes(sampleRate);
+    setEngineRate(sampleRate);
+    limiter.setLookahead(limiterLookahead);
+    dryDelay.setLength(resonatorLag());
+    aLagDelay.setLength(resonatorLag() / 2);
+    for (auto& voice : voices)
+        voice.bInput.setLength(resonatorLag() / 2);
+    reportLatency();
+    blockSize = std::max(1, samplesPerBlock);
+    inMix.resize(blockSize);
+    outL.resize(blockSize);
+    outR.resize(blockSize);
+    hostL.resize(blockSize);
+    hostR.resize(blockSize);
+    chunkMidi.ensureSize(4096);
     resetLastModels(); // FIX - ableton initial load causes async value reset that overrides loaded patch value for a_model and b_model
+    processCommands(); // audio is stopped, apply pending commands now
     clearVoices();
     onSlider();
+    seedNoise(isNonRealtime());
+}
+
+// offline renders use fixed seeds so the same input renders the same noise
+void RipplerXAudioProcessor::seedNoise(bool deterministic)
+{
+    auto seed = deterministic ? globals::NOISE_SEED : (uint32_t)juce::Random::getSystemRandom().nextInt();
+    for (int i = 0; i < globals::MAX_POLYPHONY; ++i)
+        voices[i].noise.seed(seed + (uint32_t)i * 0x10000);
 }
 
 void RipplerXAudioProcessor::releaseResources()
@@ -388,32 +447,32 @@ int RipplerXAudioProcessor::pickVoice(int note) {
 
     // Priority 1: note already playing in a voice
     if (reuseVoices) {
-        for (int i = 0; i < polyphony; ++i) {
-            if (voices[i]->note == note) {
+        for (int i = 0; i < numVoices; ++i) {
+            if (voices[i].note == note) {
                 return i;
             }
         }
     }
 
     int pick = 0;
-    for (int i = 1; i < polyphony; ++i) {
+    for (int i = 1; i < numVoices; ++i) {
         const auto& v1 = voices[i];
         const auto& v2 = voices[pick];
 
         // Priority 2: Released voices come before pressed ones
-        if (!v1->isPressed && v2->isPressed) {
+        if (!v1.isPressed && v2.isPressed) {
             pick = i;
         }
-        else if (v1->isPressed && !v2->isPressed) {
+        else if (v1.isPressed && !v2.isPressed) {
             // keep current pick (v2 is released, which has priority)
         }
         // Priority 3: Among released voices, pick oldest release
-        else if (!v1->isPressed && !v2->isPressed) {
-            if (v1->release_ts < v2->release_ts) pick = i;
+        else if (!v1.isPressed && !v2.isPressed) {
+            if (v1.release_ts < v2.release_ts) pick = i;
         }
         // Priority 4: Among pressed voices, pick oldest press
-        else if (v1->isPressed && v2->isPressed) {
-            if (v1->pressed_ts < v2->pressed_ts) pick = i;
+        else if (v1.isPressed && v2.isPressed) {
+            if (v1.pressed_ts < v2.pressed_ts) pick = i;
         }
     }
 
@@ -422,15 +481,21 @@ int RipplerXAudioProcessor::pickVoice(int note) {
 
 void RipplerXAudioProcessor::onNote(MIDIMsg msg)
 {
-    auto srate = getSampleRate();
+    auto srate = engineRate;
 
     int nvoice = pickVoice(msg.note);
-    Voice& voice = *voices[nvoice];
+    Voice& voice = voices[nvoice];
 
     bool reuse_voices = (bool)params.getRawParameterValue("reuse_voices")->load();
     bool fadeout_repeats = (bool)params.getRawParameterValue("fadeout_repeats")->load();
     bool skip_fadeout = reuse_voices && !fadeout_repeats && voice.note == msg.note;
 
+    // voice kept ringing with the previous program, switch it to the current params,
+    // a ringing voice fades out with the previous params first and switches when the fade ends
+    if (voice.pendingParams && (skip_fadeout || !voice.isResonating())) {
+        applyVoiceParams(voice);
+    }
+
     auto mallet_type = (MalletType)params.getRawParameterValue("mallet_type")->load();
     auto mallet_stiff = (double)params.getRawParameterValue("mallet_stiff")->load();
     auto mallet_ktrack = (double)params.getRawParameterValue("mallet_ktrack")->load();
@@ -438,118 +503,145 @@ void RipplerXAudioProcessor::onNote(MIDIMsg msg)
     auto malletFreq = fmax(100.0, fmin(5000.0, exp(log(mallet_stiff) + msg.vel / 127.0 * vel_mallet_stiff * 2.0 * (log(5000.0) - log(100.0)))));
 
     voice.trigger(++note_press_count, srate, msg.note, msg.vel / 127.0, mallet_type, malletFreq, mallet_ktrack, skip_fadeout, mtsClientPtr);
+    activateVoice(nvoice);
 }
 
 void RipplerXAudioProcessor::offNote(MIDIMsg msg)
 {
-    for (int i = 0; i < polyphony; ++i) {
-        Voice& voice = *voices[i];
+    for (int i = 0; i < numVoices; ++i) {
+        Voice& voice = voices[i];
         if (voice.note == msg.note && !voice.isRelease) {
             voice.release(++note_release_count);
         }
     }
 }
 
-void RipplerXAudioProcessor::onSlider()
+void RipplerXAudioProcessor::onSlider(bool programChange)
 {
-    auto srate = getSampleRate();
+    auto& p = voiceParams;
+    p.srate = engineRate;
 
-    auto mallet_type = (MalletType)params.getRawParameterValue("mallet_type")->load();
+    p.mallet_type = (MalletType)params.getRawParameterValue("mallet_type")->load();
     auto mallet_pitch = (double)params.getRawParameterValue("mallet_pitch")->load();
-    auto mallet_filter = (double)params.getRawParameterValue("mallet_filter")->load();
-
-    auto noise_filter_freq = (double)params.getRawParameterValue("noise_filter_freq")->load();
-    auto noise_filter_mode = (int)params.getRawParameterValue("noise_filter_mode")->load();
-    auto noise_filter_q = (double)params.getRawParameterValue("noise_filter_q")->load();
-    auto noise_att = (double)params.getRawParameterValue("noise_att")->load();
-    auto noise_dec = (double)params.getRawParameterValue("noise_dec")->load();
-    auto noise_sus = (double)params.getRawParameterValue("noise_sus")->load();
-    auto noise_rel = (double)params.getRawParameterValue("noise_rel")->load();
-    auto noise_att_ten = (double)params.getRawParameterValue("noise_att_ten")->load();
-    auto noise_dec_ten = (double)params.getRawParameterValue("noise_dec_ten")->load();
-    auto noise_rel_ten = (double)params.getRawParameterValue("noise_rel_ten")->load();
-    auto vel_noise_freq = params.getRawParameterValue("vel_noise_freq")->load();
-    auto vel_noise_q = params.getRawParameterValue("vel_noise_q")->load();
-    auto vel_noise_att = (double)params.getRawParameterValue("vel_noise_att")->load();
-    auto vel_noise_dec = (double)params.getRawParameterValue("vel_noise_dec")->load();
-    auto vel_noise_sus = (double)params.getRawParameterValue("vel_noise_sus")->load();
-    auto vel_noise_rel = (double)params.getRawParameterValue("vel_noise_rel")->load();
-
-    auto a_on = (bool)params.getRawParameterValue("a_on")->load();
-    auto a_model = (int)params.getRawParameterValue("a_model")->load();
+    p.mallet_filter = (double)params.getRawParameterValue("mallet_filter")->load();
+
+    p.noise_filter_freq = (double)params.getRawParameterValue("noise_filter_freq")->load();
+    p.noise_filter_mode = (int)params.getRawParameterValue("noise_filter_mode")->load();
+    p.noise_filter_q = (double)params.getRawParameterValue("noise_filter_q")->load();
+    p.noise_att = (double)params.getRawParameterValue("noise_att")->load();
+    p.noise_dec = (double)params.getRawParameterValue("noise_dec")->load();
+    p.noise_sus = (double)params.getRawParameterValue("noise_sus")->load();
+    p.noise_rel = (double)params.getRawParameterValue("noise_rel")->load();
+    p.noise_att_ten = (double)params.getRawParameterValue("noise_att_ten")->load();
+    p.noise_dec_ten = (double)params.getRawParameterValue("noise_dec_ten")->load();
+    p.noise_rel_ten = (double)params.getRawParameterValue("noise_rel_ten")->load();
+    p.vel_noise_freq = (double)params.getRawParameterValue("vel_noise_freq")->load();
+    p.vel_noise_q = (double)params.getRawParameterValue("vel_noise_q")->load();
+    p.vel_noise_att = (double)params.getRawParameterValue("vel_noise_att")->load();
+    p.vel_noise_dec = (double)params.getRawParameterValue("vel_noise_dec")->load();
+    p.vel_noise_sus = (double)params.getRawParameterValue("vel_noise_sus")->load();
+    p.vel_noise_rel = (double)params.getRawParameterValue("vel_noise_rel")->load();
+
+    p.a_on = (bool)params.getRawParameterValue("a_on")->load();
+    p.a_model = (int)params.getRawParameterValue("a_model")->load();
     auto a_partials = (int)params.getRawParameterValue("a_partials")->load();
-    auto a_decay = (double)params.getRawParameterValue("a_decay")->load();
-    auto a_damp = (double)params.getRawParameterValue("a_damp")->load();
-    auto a_tone = (double)params.getRawParameterValue("a_tone")->load();
-    auto a_hit = (double)params.getRawParameterValue("a_hit")->load();
-    auto a_rel = (double)params.getRawParameterValue("a_rel")->load();
-    auto a_inharm = (double)params.getRawParameterValue("a_inharm")->load();
-    auto a_ratio = (double)params.getRawParameterValue("a_ratio")->load();
-    auto a_cut = (double)params.getRawParameterValue("a_cut")->load();
-    auto a_radius = (double)params.getRawParameterValue("a_radius")->load();
-
-    auto b_on = (bool)params.getRawParameterValue("b_on")->load();
-    auto b_model = (int)params.getRawParameterValue("b_model")->load();
+    p.a_decay = (double)params.getRawParameterValue("a_decay")->load();
+    p.a_damp = (double)params.getRawParameterValue("a_damp")->load();
+    p.a_tone = (double)params.getRawParameterValue("a_tone")->load();
+    p.a_hit = (double)params.getRawParameterValue("a_hit")->load();
+    p.a_rel = (double)params.getRawParameterValue("a_rel")->load();
+    p.a_inharm = (double)params.getRawParameterValue("a_inharm")->load();
+    p.a_ratio = (double)params.getRawParameterValue("a_ratio")->load();
+    p.a_cut = (double)params.getRawParameterValue("a_cut")->load();
+    p.a_radius = (double)params.getRawParameterValue("a_radius")->load();
+
+    p.b_on = (bool)params.getRawParameterValue("b_on")->load();
+    p.b_model = (int)params.getRawParameterValue("b_model")->load();
     auto b_partials = (int)params.getRawParameterValue("b_partials")->load();
-    auto b_decay = (double)params.getRawParameterValue("b_decay")->load();
-    auto b_damp = (double)params.getRawParameterValue("b_damp")->load();
-    auto b_tone = (double)params.getRawParameterValue("b_tone")->load();
-    auto b_hit = (double)params.getRawParameterValue("b_hit")->load();
-    auto b_rel = (double)params.getRawParameterValue("b_rel")->load();
-    auto b_inharm = (double)params.getRawParameterValue("b_inharm")->load();
-    auto b_ratio = (double)params.getRawParameterValue("b_ratio")->load();
-    auto b_cut = (double)params.getRawParameterValue("b_cut")->load();
-    auto b_radius = (double)params.getRawParameterValue("b_radius")->load();
-
-    auto vel_a_decay = (double)params.getRawParameterValue("vel_a_decay")->load();
-    auto vel_a_hit = (double)params.getRawParameterValue("vel_a_hit")->load();
-    auto vel_a_inharm = (double)params.getRawParameterValue("vel_a_inharm")->load();
-    auto vel_a_damp = (double)params.getRawParameterValue("vel_a_damp")->load();
-    auto vel_a_tone = (double)params.getRawParameterValue("vel_a_tone")->load();
-    auto vel_b_decay = (double)params.getRawParameterValue("vel_b_decay")->load();
-    auto vel_b_hit = (double)params.getRawParameterValue("vel_b_hit")->load();
-    auto vel_b_inharm = (double)params.getRawParameterValue("vel_b_inharm")->load();
-    auto vel_b_damp = (double)params.getRawParameterValue("vel_b_damp")->load();
-    auto vel_b_tone = (double)params.getRawParameterValue("vel_b_tone")->load();
-
-    auto a_coarse = (double)params.getRawParameterValue("a_coarse")->load();
-    auto a_fine = (double)params.getRawParameterValue("a_fine")->load();
-    auto b_coarse = (double)params.getRawParameterValue("b_coarse")->load();
-    auto b_fine = (double)params.getRawParameterValue("b_fine")->load();
-
-    auto couple = (bool)params.getRawParameterValue("couple")->load();
-    auto split = (double)params.getRawParameterValue("ab_split")->load() * 100.0;
-
-    if (a_model != last_a_model) {
+    p.b_decay = (double)params.getRawParameterValue("b_decay")->load();
+    p.b_damp = (double)params.getRawParameterValue("b_damp")->load();
+    p.b_tone = (double)params.getRawParameterValue("b_tone")->load();
+    p.b_hit = (double)params.getRawParameterValue("b_hit")->load();
+    p.b_rel = (double)params.getRawParameterValue("b_rel")->load();
+    p.b_inharm = (double)params.getRawParameterValue("b_inharm")->load();
+    p.b_ratio = (double)params.getRawParameterValue("b_ratio")->load();
+    p.b_cut = (double)params.getRawParameterValue("b_cut")->load();
+    p.b_radius = (double)params.getRawParameterValue("b_radius")->load();
+
+    p.vel_a_decay = (double)params.getRawParameterValue("vel_a_decay")->load();
+    p.vel_a_hit = (double)params.getRawParameterValue("vel_a_hit")->load();
+    p.vel_a_inharm = (double)params.getRawParameterValue("vel_a_inharm")->load();
+    p.vel_a_damp = (double)params.getRawParameterValue("vel_a_damp")->load();
+    p.vel_a_tone = (double)params.getRawParameterValue("vel_a_tone")->load();
+    p.vel_b_decay = (double)params.getRawParameterValue("vel_b_decay")->load();
+    p.vel_b_hit = (double)params.getRawParameterValue("vel_b_hit")->load();
+    p.vel_b_inharm = (double)params.getRawParameterValue("vel_b_inharm")->load();
+    p.vel_b_damp = (double)params.getRawParameterValue("vel_b_damp")->load();
+    p.vel_b_tone = (double)params.getRawParameterValue("vel_b_tone")->load();
+
+    p.a_coarse = (double)params.getRawParameterValue("a_coarse")->load();
+    p.a_fine = (double)params.getRawParameterValue("a_fine")->load();
+    p.b_coarse = (double)params.getRawParameterValue("b_coarse")->load();
+    p.b_fine = (double)params.getRawParameterValue("b_fine")->load();
+
+    p.couple = (bool)params.getRawParameterValue("couple")->load();
+    p.split = (double)params.getRawParameterValue("ab_split")->load() * 100.0;
+    p.harmonic_tubes = (bool)params.getRawParameterValue("harmonic_tubes")->load();
+    p.multirate = multiratePartials;
+    p.max_bend = pow(2.0, (double)params.getRawParameterValue("bend_range")->load() / 12.0);
+
+    auto& noise_mix_range = params.getParameter("noise_mix")->getNormalisableRange();
+    auto& noise_res_range = params.getParameter("noise_res")->getNormalisableRange();
+    p.mix.mallet_mix = (double)params.getRawParameterValue("mallet_mix")->load();
+    p.mix.mallet_res = (double)params.getRawParameterValue("mallet_res")->load();
+    p.mix.vel_mallet_mix = (double)params.getRawParameterValue("vel_mallet_mix")->load();
+    p.mix.vel_mallet_res = (double)params.getRawParameterValue("vel_mallet_res")->load();
+    p.mix.noise_osc = (double)params.getRawParameterValue("noise_osc")->load();
+    p.mix.noise_mix = noise_mix_range.convertTo0to1(params.getRawParameterValue("noise_mix")->load());
+    p.mix.noise_res = noise_res_range.convertTo0to1(params.getRawParameterValue("noise_res")->load());
+    p.mix.vel_noise_mix = params.getRawParameterValue("vel_noise_mix")->load();
+    p.mix.vel_noise_res = params.getRawParameterValue("vel_noise_res")->load();
+    auto ab_mix = (double)params.getRawParameterValue("ab_mix")->load();
+    auto gain = pow(10.0, (double)params.getRawParameterValue("gain")->load() / 20.0);
+    // serial coupling outputs B only, parallel mixes A and B, otherwise one of them is off and they are summed
+    bool both = p.a_on && p.b_on;
+    p.mix.a_level = both ? (p.couple ? 0.0 : 1.0 - ab_mix) * gain : gain;
+    p.mix.b_level = both && !p.couple ? ab_mix * gain : gain;
+
+    // on program changes sounding voices keep ringing with the previous patch
+    // instead of being cleared, they receive the new params on their next note
+    bool resetVoices = false;
+
+    if (p.a_model != last_a_model) {
         auto param = params.getParameter("a_ratio");
-        a_ratio = a_model == Beam ? 2.0 : a_model == Djembe ? 1.0 : 0.78;
-        auto value = param->convertTo0to1(float(a_ratio));
+        p.a_ratio = p.a_model == Beam ? 2.0 : p.a_model == Djembe ? 1.0 : 0.78;
+        auto value = param->convertTo0to1(float(p.a_ratio));
         MessageManager::callAsync([param, value] {
             param->beginChangeGesture();
             param->setValueNotifyingHost(value);
             param->endChangeGesture();
         });
-        clearVoices();
-        last_a_model = a_model;
+        resetVoices = true;
+        last_a_model = p.a_model;
     }
-    if (b_model != last_b_model) {
+    if (p.b_model != last_b_model) {
         auto param = params.getParameter("b_ratio");
-        b_ratio = b_model == Beam ? 2.0 : b_model == Djembe ? 1.0 : 0.78;
-        auto value = param->convertTo0to1((float)b_ratio);
+        p.b_ratio = p.b_model == Beam ? 2.0 : p.b_model == Djembe ? 1.0 : 0.78;
+        auto value = param->convertTo0to1((float)p.b_ratio);
         MessageManager::callAsync([param, value] {
             param->beginChangeGesture();
             param->setValueNotifyingHost(value);
             param->endChangeGesture();
         });
-        clearVoices();
-        last_b_model = b_model;
+        resetVoices = true;
+        last_b_model = p.b_model;
     }
     if (last_a_partials != a_partials) {
-        clearVoices();
+        resetVoices = true;
         last_a_partials = a_partials;
     }
     if (last_b_partials != b_partials) {
-        clearVoices();
+        resetVoices = true;
         last_b_partials = b_partials;
     }
 
@@ -569,41 +661,71 @@ void RipplerXAudioProcessor::onSlider()
     else if (b_partials == 4) b_partials = 64;
     else if (b_partials == 5) b_partials = 1;
     else if (b_partials == 6) b_partials = 2;
-
-    if (a_model == ModalModels::Beam) models->recalcBeam(true, a_ratio);
-    else if (a_model == ModalModels::Membrane) models->recalcMembrane(true, a_ratio);
-    else if (a_model == ModalModels::Plate) models->recalcPlate(true, a_ratio);
-    if (b_model == ModalModels::Beam) models->recalcBeam(false, b_ratio);
-    else if (b_model == ModalModels::Membrane) models->recalcMembrane(false, b_ratio);
-    else if (b_model == ModalModels::Plate) models->recalcPlate(false, b_ratio);
-
-    if (mallet_type != l_mallet_type) {
-        l_mallet_type = mallet_type;
-        if (mallet_type > MalletType::kUserFile) {
-            malletSampler->loadInternalSample(mallet_type);
+    p.a_partials = a_partials;
+    p.b_partials = b_partials;
+
+    if (p.a_model == ModalModels::Beam) models->recalcBeam(true, p.a_ratio);
+    else if (p.a_model == ModalModels::Membrane) models->recalcMembrane(true, p.a_ratio);
+    else if (p.a_model == ModalModels::Plate) models->recalcPlate(true, p.a_ratio);
+    if (p.b_model == ModalModels::Beam) models->recalcBeam(false, p.b_ratio);
+    else if (p.b_model == ModalModels::Membrane) models->recalcMembrane(false, p.b_ratio);
+    else if (p.b_model == ModalModels::Plate) models->recalcPlate(false, p.b_ratio);
+
+    if (p.mallet_type != l_mallet_type) {
+        l_mallet_type = p.mallet_type;
+        if (p.mallet_type > MalletType::kUserFile) {
+            if (programChange)
+                holdMalletSample();
+            malletSampler->loadInternalSample(p.mallet_type);
         }
+        resetVoices = true;
+    }
+
+    if (resetVoices && !programChange) {
         clearVoices();
     }
 
     malletSampler->setPitch(mallet_pitch);
-
-    for (int i = 0; i < polyphony; i++) {
-        Voice& voice = *voices[i];
-        voice.noise.init(srate, noise_filter_mode, noise_filter_freq, noise_filter_q, noise_att, 
-            noise_dec, noise_sus, noise_rel, vel_noise_freq, vel_noise_q, noise_att_ten, noise_dec_ten, noise_rel_ten,
-            vel_noise_att, vel_noise_dec, vel_noise_sus, vel_noise_rel
-        );
-        voice.setPitch(a_coarse, b_coarse, a_fine, b_fine, curBend);
-        voice.setRatio(a_ratio, b_ratio);
-        voice.resA.setParams(srate, a_on, a_model, a_partials, a_decay, a_damp, a_tone, a_hit, a_rel, 
-            a_inharm, a_cut, a_radius, vel_a_decay, vel_a_hit, vel_a_inharm, vel_a_damp, vel_a_tone);
-        voice.resB.setParams(srate, b_on, b_model, b_partials, b_decay, b_damp, b_tone, b_hit, b_rel, 
-            b_inharm, b_cut, b_radius, vel_b_decay, vel_b_hit, vel_b_inharm, vel_b_damp, vel_b_tone);
-        voice.setCoupling(couple, split);
-        voice.updateResonators();
-        if (mallet_type >= MalletType::kUserFile) {
-            voice.mallet.setFilter(mallet_filter);
+    Resonator::setCutFilter(aCutBus, p.srate, p.a_cut);
+    Resonator::setCutFilter(bCutBus, p.srate, p.b_cut);
+
+    for (int i = 0; i < numVoices; i++) {
+        Voice& voice = voices[i];
+        if (programChange && voice.isActive()) {
+            voice.pendingParams = true;
+            continue;
         }
+        applyVoiceParams(voice);
+    }
+}
+
+// applies the params resolved by the last onSlider() to a voice
+void RipplerXAudioProcessor::applyVoiceParams(Voice& voice)
+{
+    auto& p = voiceParams;
+    voice.pendingParams = false;
+    voice.mix = p.mix;
+    voice.noise.init(p.srate, p.noise_filter_mode, p.noise_filter_freq, p.noise_filter_q, p.noise_att, 
+        p.noise_dec, p.noise_sus, p.noise_rel, p.vel_noise_freq, p.vel_noise_q, p.noise_att_ten, p.noise_dec_ten, p.noise_rel_ten,
+        p.vel_noise_att, p.vel_noise_dec, p.vel_noise_sus, p.vel_noise_rel
+    );
+    voice.setPitch(p.a_coarse, p.b_coarse, p.a_fine, p.b_fine, curBend);
+    voice.setRatio(p.a_ratio, p.b_ratio);
+    voice.resA.harmonicTubes = p.harmonic_tubes;
+    voice.resB.harmonicTubes = p.harmonic_tubes;
+    voice.resA.multirate = p.multirate;
+    voice.resB.multirate = p.multirate;
+    voice.resA.maxBend = p.max_bend;
+    voice.resB.maxBend = p.max_bend;
+    voice.resA.setParams(p.srate, p.a_on, p.a_model, p.a_partials, p.a_decay, p.a_damp, p.a_tone, p.a_hit, p.a_rel, 
+        p.a_inharm, p.a_cut, p.a_radius, p.vel_a_decay, p.vel_a_hit, p.vel_a_inharm, p.vel_a_damp, p.vel_a_tone);
+    voice.resB.setParams(p.srate, p.b_on, p.b_model, p.b_partials, p.b_decay, p.b_damp, p.b_tone, p.b_hit, p.b_rel, 
+        p.b_inharm, p.b_cut, p.b_radius, p.vel_b_decay, p.vel_b_hit, p.vel_b_inharm, p.vel_b_damp, p.vel_b_tone);
+    voice.setCoupling(p.couple, p.split);
+    voice.loadModels();
+    voice.updateResonators();
+    if (p.mallet_type >= MalletType::kUserFile) {
+        voice.mallet.setFilter(p.mallet_filter);
     }
 }
 
@@ -626,72 +748,77 @@ template <typename FloatType>
 void RipplerXAudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals disableDenormals;
-    auto totalNumOutputChannels = getTotalNumOutputChannels();
-    auto totalNumInputChannels = getTotalNumInputChannels();
     auto numSamples = buffer.getNumSamples();
 
-    auto a_on = (bool)params.getRawParameterValue("a_on")->load();
-    auto b_on = (bool)params.getRawParameterValue("b_on")->load();
-    auto mallet_mix = (double)params.getRawParameterValue("mallet_mix")->load();
-    auto mallet_res = (double)params.getRawParameterValue("mallet_res")->load();
-    auto vel_mallet_mix = (double)params.getRawParameterValue("vel_mallet_mix")->load();
-    auto vel_mallet_res = (double)params.getRawParameterValue("vel_mallet_res")->load();
-    auto noise_osc = (double)params.getRawParameterValue("noise_osc")->load();
-    auto noise_mix = params.getRawParameterValue("noise_mix")->load();
-    auto noise_mix_range = params.getParameter("noise_mix")->getNormalisableRange();
-    noise_mix = noise_mix_range.convertTo0to1(noise_mix);
-    auto noise_res = params.getRawParameterValue("noise_res")->load();
-    auto noise_res_range = params.getParameter("noise_res")->getNormalisableRange();
-    noise_res = noise_res_range.convertTo0to1(noise_res);
-    auto vel_noise_mix = params.getRawParameterValue("vel_noise_mix")->load();
-    auto vel_noise_res = params.getRawParameterValue("vel_noise_res")->load();
-    auto serial = (bool)params.getRawParameterValue("couple")->load();
-    auto ab_mix = (double)params.getRawParameterValue("ab_mix")->load();
-    auto gain = (double)params.getRawParameterValue("gain")->load();
-    auto couple = (bool)params.getRawParameterValue("couple")->load();
-    gain = pow(10.0, gain / 20.0);
-    auto bend_range = (double)params.getRawParameterValue("bend_range")->load();
-    auto stereoizer = (bool)params.getRawParameterValue("stereoizer")->load();
+    // host sent a larger block than announced, process it in chunks so the buffers are never resized here
+    if (numSamples > blockSize) {
+        for (int start = 0; start < numSamples; start += blockSize) {
+            auto count = std::min(blockSize, numSamples - start);
+            AudioBuffer<FloatType> chunk(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, count);
+            chunkMidi.clear();
+            chunkMidi.addEvents(midiMessages, start, count, -start);
+            processBlockByType(chunk, chunkMidi);
+        }
+        midiMessages.clear();
+        return;
+    }
 
-    auto setBendTarget = [this, bend_range](double pitchWheel)
-        {
-            double normalized = (pitchWheel - 8192) / 8191.0;
-            startBend = curBend;
-            targetBend = std::pow(2.0, normalized * bend_range / 12.0);
-            remainingSamplesBend = totalSamplesBend;
-            bendStep = (targetBend - startBend) / (double)totalSamplesBend;
-        };
+    // an offline render starts again from the fixed seeds, also when the host renders again
+    // from an earlier position without preparing, so every render of the same input matches
+    if (isNonRealtime()) {
+        auto time = renderTime;
+        if (auto* playHead = getPlayHead())
+            if (auto position = playHead->getPosition())
+                time = position->getTimeInSamples().orFallback(renderTime);
+        if (!wasNonRealtime || time < renderTime)
+            seedNoise(true);
+        wasNonRealtime = true;
+        renderTime = time;
+    }
+    else {
+        wasNonRealtime = false;
+    }
 
-    auto interpolatePitchBend = [this]()
-        {
-            if (remainingSamplesBend > 0) {
-                curBend += bendStep;
+    auto totalNumOutputChannels = getTotalNumOutputChannels();
+    auto totalNumInputChannels = getTotalNumInputChannels();
 
-                --remainingSamplesBend;
+    auto bend_range = (double)params.getRawParameterValue("bend_range")->load();
+    auto stereoizer = (bool)params.getRawParameterValue("stereoizer")->load();
+    auto shared_cut = (bool)params.getRawParameterValue("shared_cut")->load();
 
-                if (remainingSamplesBend == 0) {
-                    curBend = targetBend;
-                }
-            }
-        };
+    RenderParams rp{ params.getParameter("noise_mix")->getNormalisableRange(),
+        params.getParameter("noise_res")->getNormalisableRange(), bend_range };
 
     // remove midi messages that have been processed
     midi.erase(std::remove_if(midi.begin(), midi.end(), [](const MIDIMsg& msg) {
         return msg.offset < 0;
     }), midi.end());
 
-    if (paramChanged) {
-        onSlider();
-        paramChanged = false;
+    processCommands();
+
+    // skipped while a program is writing its params, the flag is consumed every block
+    // so a program change never applies to later param tweaks
+    {
+        const juce::ScopedTryLock programLocked(programLock);
+        if (programLocked.isLocked()) {
+            bool programChange = programChanged.exchange(false);
+            if (paramChanged) {
+                onSlider(programChange);
+                paramChanged = false;
+            }
+        }
     }
 
+    // engine samples of this block, the midi offsets are mapped to the engine sample that follows them
+    auto engineSamples = Resampler::engineSamples(numSamples, ratePhase, rateFactor);
+
     // Process new MIDI messages
     keyboardState.processNextMidiBuffer(midiMessages, 0, buffer.getNumSamples(), true);
     for (const auto metadata : midiMessages) {
         juce::MidiMessage message = metadata.getMessage();
         if (message.isNoteOn() || message.isNoteOff() || message.isSustainPedalOn() || message.isSustainPedalOff())
             midi.push_back({ // queue midi message
-                metadata.samplePosition,
+                Resampler::engineSamples(metadata.samplePosition, ratePhase, rateFactor),
                 message.isNoteOn() ? MIDIMsgType::NoteOn
                 : message.isNoteOff() ? MIDIMsgType::NoteOff
                 : message.isSustainPedalOn() ? MIDIMsgType::SustainPedalOn
@@ -705,16 +832,150 @@ void RipplerXAudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer,
             clearVoices();
         else if (message.isPitchWheel())
             midi.push_back({
-                metadata.samplePosition,
+                Resampler::engineSamples(metadata.samplePosition, ratePhase, rateFactor),
                 MIDIMsgType::PitchWheel,
                 0,
                 message.getPitchWheelValue(),
             });
     }
 
+    // no voice is sounding and the comb and limiter have flushed their tails, output silence without running the voices
+    if (isIdle(engineSamples)) {
+        for (auto& msg : midi)
+            msg.offset -= engineSamples;
+        for (int i = 0; i < engineSamples && remainingSamplesBend > 0; ++i)
+            interpolatePitchBend();
+        if (remainingSamplesBend >= 0) {
+            for (int i = 0; i < numVoices; ++i)
+                voices[i].applyPitchBend(curBend);
+            if (remainingSamplesBend == 0)
+                remainingSamplesBend = -1;
+        }
+        buffer.clear();
+        quietSamples = std::min(quietSamples + engineSamples, std::numeric_limits<int>::max() / 2);
+        resamplerIn.clear(); // the output resamplers are flushed by the quiet samples
+        ratePhase = (ratePhase + numSamples) & (rateFactor - 1);
+        if (numSamples > 0)
+            meterLevels.push({ 0.f, 0.f, 0.f, 0.f, numSamples });
+        midiMessages.clear();
+        return;
+    }
+
+    // apply the cut filters once on the summed A and B outputs when every voice uses the same cut,
+    // a filter is linear so this matches filtering each voice except for voice fades that are applied before the filter
+    bool cutBusA = shared_cut && voiceParams.a_cut != 0.0;
+    bool cutBusB = shared_cut && voiceParams.b_cut != 0.0;
+    if (cutBusA || cutBusB) {
+        for (int k = 0; k < numActiveVoices; ++k) {
+            Voice& voice = voices[activeVoices[k]];
+            if (!voice.isActive()) continue;
+            if (voice.resA.on && (voice.couple || fabs(voice.resA.cut - voiceParams.a_cut) > CUT_TOLERANCE))
+                cutBusA = false; // serial coupling feeds each voice filtered A output into B
+            if (voice.resB.on && fabs(voice.resB.cut - voiceParams.b_cut) > CUT_TOLERANCE)
+                cutBusB = false;
+        }
+    }
+    switchCutBus(cutBusA, cutBusB);
+
+    // downmix audio input to mono
+    std::fill(inMix.begin(), inMix.begin() + numSamples, 0.0);
+    for (int ch = 0; ch < totalNumInputChannels; ++ch) {
+        auto in = buffer.getReadPointer(ch);
+        auto mix = inMix.data();
+        for (int i = 0; i < numSamples; ++i)
+            mix[i] += (double)in[i];
+    }
+    if (totalNumInputChannels > 1) {
+        auto scale = 1.0 / (double)totalNumInputChannels;
+        for (int i = 0; i < numSamples; ++i)
+            inMix[i] *= scale;
+    }
+    resamplerIn.decimate(inMix.data(), inMix.data(), numSamples, ratePhase);
+
+    // impulse mallets and noise run in lanes across voices,
+    // the voices are stored back before any event that changes them
+    loadExcitation();
+
+    // voices ringing with the previous program may still run the noise oscillators
+    auto usesOscillators = [](const VoiceMix& m) { return m.noise_osc > 0.0 && (m.noise_res > 0.0 || m.vel_noise_res > 0.0); };
+    auto noiseOsc = usesOscillators(voiceParams.mix);
+    for (int k = 0; k < numActiveVoices && !noiseOsc; ++k)
+        noiseOsc = usesOscillators(voices[activeVoices[k]].mix);
+    (this->*renderKernels[cutBusA][cutBusB][noiseOsc])(engineSamples, rp);
+
+    // count the trailing silence before the comb, the comb and limiter tails are flushed once it covers their delays
+    int lastLoud = engineSamples - 1;
+    while (lastLoud >= 0 && std::abs(outL[lastLoud]) < IDLE_THRESHOLD)
+        --lastLoud;
+    quietSamples = lastLoud < 0
+        ? std::min(quietSamples + engineSamples, std::numeric_limits<int>::max() / 2)
+        : engineSamples - 1 - lastLoud;
+
+    if (stereoizer)
+        comb.process(outL.data(), outL.data(), outR.data(), engineSamples);
+    else
+        std::copy(outL.begin(), outL.begin() + engineSamples, outR.begin());
+
+    limiter.process(outL.data(), outR.data(), engineSamples);
+
+    const double* left = outL.data();
+    const double* right = outR.data();
+    if (rateFactor > 1) {
+        resamplerL.interpolate(outL.data(), hostL.data(), numSamples, ratePhase);
+        resamplerR.interpolate(outR.data(), hostR.data(), numSamples, ratePhase);
+        left = hostL.data();
+        right = hostR.data();
+    }
+    ratePhase = (ratePhase + numSamples) & (rateFactor - 1);
+
+    for (int channel = 0; channel < totalNumOutputChannels; ++channel) {
+        auto src = !channel ? left : right;
+        auto out = buffer.getWritePointer(channel);
+        for (int i = 0; i < numSamples; ++i)
+            out[i] = static_cast<FloatType>(src[i]);
+    }
+
+    storeExcitation();
+    sweepVoices();
+
+    // output levels for the meter, dropped if the editor is closed and the queue is full
+    double peakL = 0.0, peakR = 0.0, sumL = 0.0, sumR = 0.0;
+    for (int i = 0; i < numSamples; ++i) {
+        peakL = std::max(peakL, std::abs(left[i]));
+        peakR = std::max(peakR, std::abs(right[i]));
+        sumL += left[i] * left[i];
+        sumR += right[i] * right[i];
+    }
+    if (numSamples > 0) {
+        meterLevels.push({ (float)peakL, (float)peakR, 
+            (float)std::sqrt(sumL / numSamples), (float)std::sqrt(sumR / numSamples), numSamples });
+    }
+    midiMessages.clear(); // attempt fix rare crash when clicking the piano keys
+}
+
+// Renders the voices into outL, specialized on the routing that is fixed for the block
+// so the per sample loop has no branches on the shared cut filters and the noise oscillators, the A and B mix is a level per voice
+template <bool CutBusA, bool CutBusB, bool NoiseOsc>
+void RipplerXAudioProcessor::renderBlock(int numSamples, const RenderParams& rp)
+{
+    auto& kernels = Kernels::get();
+
+    // the sine oscillators follow a pitch bend glide once per block, they are left detuned while unused
+    if constexpr (NoiseOsc) {
+        for (int k = 0; k < numActiveVoices; ++k) {
+            Voice& voice = voices[activeVoices[k]];
+            if (voice.oscillatorsDetuned)
+                voice.tuneOscillators();
+        }
+    }
+
     for (int sample = 0; sample < numSamples; ++sample) {
         interpolatePitchBend();
 
+        bool hasEvents = std::any_of(midi.begin(), midi.end(), [](const MIDIMsg& m) { return m.offset == 0; });
+        if (hasEvents)
+            storeExcitation();
+
         // process midi queue
         for (auto& msg : midi) {
             if (msg.offset == 0) {
@@ -751,40 +1012,72 @@ void RipplerXAudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer,
                     sustainPedalNotes.clear();
                 }
                 else if (msg.type == MIDIMsgType::PitchWheel) {
-                    setBendTarget((double)msg.vel);
+                    setBendTarget((double)msg.vel, rp.bend_range);
                 }
             }
             msg.offset -= 1;
         }
 
+        if (hasEvents)
+            loadExcitation();
+
         double dirOut = 0.0; // direct output
         double aOut = 0.0; // resonator A output
         double bOut = 0.0; // resonator B output
 
-        auto audioIn = 0.0;
-        for (int i = 0; i < totalNumInputChannels; ++i)
-            audioIn += (double)buffer.getSample(i, sample);
-        if (totalNumInputChannels) 
-            audioIn /= (double)totalNumInputChannels;
+        auto audioIn = inMix[sample];
 
-        for (int i = 0; i < polyphony; ++i) {
-            Voice& voice = *voices[i];
-            double resOut = 0.0;
+        // idle voices are skipped, they only need the bend once the glide ends since a trigger keeps the voice bend
+        if (remainingSamplesBend == 0) {
+            for (int i = 0; i < numVoices; ++i)
+                voices[i].applyPitchBend(curBend);
+            remainingSamplesBend = -1;
+        }
 
-            if (remainingSamplesBend >= 0) {
+        // voice fade out used to declick on voice note repeat, runs before the excitation
+        // because a finished fade triggers the voice mallet and noise
+        double voiceFadeOutEnvs[globals::MAX_POLYPHONY];
+        for (int k = 0; k < numActiveVoices; ++k) {
+            int i = activeVoices[k];
+            Voice& voice = voices[i];
+
+            if (remainingSamplesBend > 0)
                 voice.applyPitchBend(curBend);
-                if (remainingSamplesBend == 0)
-                    remainingSamplesBend = -1;
+
+            voiceFadeOutEnvs[i] = 1.0;
+            if (voice.isFading && voice.fadeSamples <= 1) {
+                excitation.store(voice, i);
+                if (voice.pendingParams)
+                    applyVoiceParams(voice); // the note that follows the fade starts with the current params
+                voiceFadeOutEnvs[i] = voice.fadeOut();
+                excitation.load(voice, i);
             }
+            else if (voice.isFading) {
+                voiceFadeOutEnvs[i] = voice.fadeOut();
+            }
+        }
 
-            // voice fade out used to declick on voice note repeat
-            double voiceFadeOutEnv = voice.isFading ? voice.fadeOut() : 1.0;
+        excitation.process();
+
+        // resonators input of each voice, the tubes of all voices then run together in lanes
+        alignas(32) double resIn[globals::MAX_POLYPHONY];
+        alignas(32) double resAOut[globals::MAX_POLYPHONY];
+        alignas(32) double tubeIn[globals::MAX_POLYPHONY];
+        alignas(32) double tubeOut[globals::MAX_POLYPHONY];
+        alignas(32) double tubeOn[globals::MAX_POLYPHONY] = {};
+        bool tubesOn = false;
+
+        for (int k = 0; k < numActiveVoices; ++k) {
+            int i = activeVoices[k];
+            Voice& voice = voices[i];
+            double resOut = 0.0;
+            double voiceFadeOutEnv = voiceFadeOutEnvs[i];
 
             // process mallet
-            auto msample = voice.mallet.process(); 
+            auto msample = voice.mallet.isImpulse() ? excitation.malletOut[i] : voice.mallet.process();
             if (msample) {
-                dirOut += msample * fmax(0.0, fmin(1.0, mallet_mix + vel_mallet_mix * voice.vel)) * voiceFadeOutEnv;
-                resOut += msample * fmax(0.0, fmin(1.0, mallet_res + vel_mallet_res * voice.vel));
+                dirOut += msample * fmax(0.0, fmin(1.0, voice.mix.mallet_mix + voice.mix.vel_mallet_mix * voice.vel)) * voiceFadeOutEnv;
+                resOut += msample * fmax(0.0, fmin(1.0, voice.mix.mallet_res + voice.mix.vel_mallet_res * voice.vel));
             }
 
             // process audio in
@@ -792,67 +1085,288 @@ void RipplerXAudioProcessor::processBlockByType (AudioBuffer<FloatType>& buffer,
                 resOut += audioIn;
 
             // process noise
-            auto noise = voice.noise.process(); 
-            if (voice.noise.env.state != 0) {
-                auto osc = noise_osc > 0.0 && (noise_res > 0.0 || vel_noise_res > 0.0)
-                    ? voice.noise.processOSC(voice.processOscillators(false) + voice.processOscillators(true)) * noise_osc
-                    : 0.0;
-                dirOut += noise * (double)noise_mix_range.convertFrom0to1(fmax(0.f, fmin(1.f, noise_mix + vel_noise_mix * (float)voice.vel))) * voiceFadeOutEnv;
-                resOut += (noise * (1.0 - noise_osc) + osc) * (double)noise_res_range.convertFrom0to1(fmax(0.f, fmin(1.f, noise_res + vel_noise_res * (float)voice.vel)));
+            auto noise = excitation.noiseOut[i];
+            if (excitation.isNoiseActive(i)) {
+                auto osc = 0.0;
+                if constexpr (NoiseOsc)
+                    osc = voice.noise.processOSC(voice.processOscillators(false) + voice.processOscillators(true), excitation.noiseEnv[i]) * voice.mix.noise_osc;
+                dirOut += noise * (double)rp.noise_mix_range.convertFrom0to1(fmax(0.f, fmin(1.f, voice.mix.noise_mix + voice.mix.vel_noise_mix * (float)voice.vel))) * voiceFadeOutEnv;
+                resOut += (noise * (1.0 - voice.mix.noise_osc) + osc) * (double)rp.noise_res_range.convertFrom0to1(fmax(0.f, fmin(1.f, voice.mix.noise_res + voice.mix.vel_noise_res * (float)voice.vel)));
             }
 
-            auto out_from_a = 0.0; // output from voice A into B in case of resonator serial coupling
-            if (a_on) {
-                auto out = voice.resA.process(resOut);
-                if (voice.resA.cut != 0.0)
-                    out = voice.resA.filter.df1(out);
-                aOut += out * voiceFadeOutEnv;
-                out_from_a = out;
+            resIn[i] = resOut;
+            if (voice.resA.on && voice.resA.active && voice.resA.isTube()) {
+                tubeIn[i] = voice.resA.tubeInput(resOut);
+                tubeOn[i] = 1.0;
+                tubesOn = true;
             }
+        }
 
-            if (b_on) {
-                auto out = voice.resB.process(a_on && couple ? out_from_a : resOut);
-                if (voice.resB.cut != 0.0)
-                    out = voice.resB.filter.df1(out);
-                bOut += out * voiceFadeOutEnv;
+        // use the voice flags instead of the params, voices ringing from a previous program may differ
+        if (tubesOn)
+            kernels.waveguides(tubesA, tubeIn, tubeOut, tubeOn);
+
+        for (int k = 0; k < numActiveVoices; ++k) {
+            int i = activeVoices[k];
+            Voice& voice = voices[i];
+            if (voice.resA.on) {
+                auto out = tubeOn[i] != 0.0
+                    ? voice.resA.track(voice.resA.tubeOutput(tubeOut[i]), resIn[i])
+                    : voice.resA.process(resIn[i]);
+                if (!CutBusA && voice.resA.cut != 0.0)
+                    out = voice.resA.filter.process(out);
+                // the voice levels are linear so they are applied before the shared cut filter
+                aOut += out * voiceFadeOutEnvs[i] * voice.mix.a_level;
+                resAOut[i] = out; // output from voice A into B in case of resonator serial coupling
             }
         }
 
-        double resOut = 0.0;
-        if (a_on && b_on)
-            resOut = serial ? bOut : aOut * (1-ab_mix) + bOut * ab_mix;
-        else
-            resOut = aOut + bOut; // one of them is turned off, just sum the two
+        tubesOn = false;
+        for (int k = 0; k < numActiveVoices; ++k) {
+            int i = activeVoices[k];
+            Voice& voice = voices[i];
+            tubeOn[i] = 0.0;
+            // with multirate on A lags LAG samples, B gets its input with the same lag when A does not feed it
+            // so every B output lags twice LAG, the delay keeps running so the coupling can change on a ringing note
+            auto delayedIn = voice.bInput.process(resIn[i]);
+            resIn[i] = voice.resA.on && voice.couple ? resAOut[i] : delayedIn;
+            if (voice.resB.on && voice.resB.active && voice.resB.isTube()) {
+                tubeIn[i] = voice.resB.tubeInput(resIn[i]);
+                tubeOn[i] = 1.0;
+                tubesOn = true;
+            }
+        }
 
-        double totalOut = dirOut + resOut * gain;
+        if (tubesOn)
+            kernels.waveguides(tubesB, tubeIn, tubeOut, tubeOn);
+
+        for (int k = 0; k < numActiveVoices; ++k) {
+            int i = activeVoices[k];
+            Voice& voice = voices[i];
+            if (voice.resB.on) {
+                auto out = tubeOn[i] != 0.0
+                    ? voice.resB.track(voice.resB.tubeOutput(tubeOut[i]), resIn[i])
+                    : voice.resB.process(resIn[i]);
+                if (!CutBusB && voice.resB.cut != 0.0)
+                    out = voice.resB.filter.process(out);
+                bOut += out * voiceFadeOutEnvs[i] * voice.mix.b_level;
+            }
+        }
 
-        double spl0, spl1;
-        if (stereoizer) {
-            std::tie(spl0, spl1) = comb.process(totalOut);
+        if constexpr (CutBusA) {
+            aOut = aCutBus.process(aOut);
+        }
+        else if (cutTailA) {
+            aOut += aCutBus.process(0.0);
+            cutTailA = aCutBus.stateLevel() > IDLE_THRESHOLD;
         }
-        else {
-            spl0 = totalOut;
-            spl1 = totalOut;
+        aOut = aLagDelay.process(aOut); // after the shared cut filter, its state is handed over from the voice filters
+        if constexpr (CutBusB) {
+            bOut = bCutBus.process(bOut);
+        }
+        else if (cutTailB) {
+            bOut += bCutBus.process(0.0);
+            cutTailB = bCutBus.stateLevel() > IDLE_THRESHOLD;
         }
-        auto [left, right] = limiter.process(spl0, spl1);
 
-        for (int channel = 0; channel < totalNumOutputChannels; ++channel)
-        {
-            buffer.setSample(channel, sample, static_cast<FloatType>(!channel ? left : right));
+        double totalOut = dryDelay.process(dirOut) + aOut + bOut;
+
+        outL[sample] = totalOut;
+    }
+}
+
+const RipplerXAudioProcessor::RenderKernel RipplerXAudioProcessor::renderKernels[2][2][2] = {
+    {
+        { &RipplerXAudioProcessor::renderBlock<false, false, false>, &RipplerXAudioProcessor::renderBlock<false, false, true> },
+        { &RipplerXAudioProcessor::renderBlock<false, true, false>, &RipplerXAudioProcessor::renderBlock<false, true, true> },
+    },
+    {
+        { &RipplerXAudioProcessor::renderBlock<true, false, false>, &RipplerXAudioProcessor::renderBlock<true, false, true> },
+        { &RipplerXAudioProcessor::renderBlock<true, true, false>, &RipplerXAudioProcessor::renderBlock<true, true, true> },
+    },
+};
+
+void RipplerXAudioProcessor::setBendTarget(double pitchWheel, double bendRange)
+{
+    double normalized = (pitchWheel - 8192) / 8191.0;
+    startBend = curBend;
+    targetBend = std::pow(2.0, normalized * bendRange / 12.0);
+    remainingSamplesBend = totalSamplesBend;
+    bendStep = (targetBend - startBend) / (double)totalSamplesBend;
+}
+
+void RipplerXAudioProcessor::interpolatePitchBend()
+{
+    if (remainingSamplesBend > 0) {
+        curBend += bendStep;
+
+        --remainingSamplesBend;
+
+        if (remainingSamplesBend == 0) {
+            curBend = targetBend;
         }
     }
+}
 
-    float rms = (float)buffer.getRMSLevel(0, 0, buffer.getNumSamples());
-    rmsValue.store(rms, std::memory_order_release);
-    midiMessages.clear(); // attempt fix rare crash when clicking the piano keys
+bool RipplerXAudioProcessor::isIdle(int numSamples) const
+{
+    for (int k = 0; k < numActiveVoices; ++k)
+        if (voices[activeVoices[k]].isActive())
+            return false;
+
+    for (auto& msg : midi)
+        if (msg.offset < numSamples)
+            return false;
+
+    return quietSamples > dryDelay.getLength() + comb.getDelay() + limiter.getLatency() + Limiter::BLOCK + resamplerL.getTail();
 }
 
 void RipplerXAudioProcessor::clearVoices()
 {
     for (int i = 0; i < globals::MAX_POLYPHONY; ++i) {
-        Voice& voice = *voices[i];
+        Voice& voice = voices[i];
         voice.clear();
     }
+    aCutBus.clear();
+    bCutBus.clear();
+    cutTailA = false;
+    cutTailB = false;
+    numActiveVoices = 0;
+}
+
+// adds a triggered voice to the active list, a stolen voice is already there
+void RipplerXAudioProcessor::activateVoice(int index)
+{
+    int k = 0;
+    while (k < numActiveVoices && activeVoices[k] < index)
+        ++k;
+    if (k < numActiveVoices && activeVoices[k] == index)
+        return;
+    for (int j = numActiveVoices; j > k; --j)
+        activeVoices[j] = activeVoices[j - 1];
+    activeVoices[k] = index;
+    ++numActiveVoices;
+}
+
+// removes the voices that finished from the active list, runs after the excitation state is stored back
+void RipplerXAudioProcessor::sweepVoices()
+{
+    int count = 0;
+    for (int k = 0; k < numActiveVoices; ++k)
+        if (voices[activeVoices[k]].isActive())
+            activeVoices[count++] = activeVoices[k];
+    numActiveVoices = count;
+}
+
+// sizes the waveguide delay lines for the lowest tube frequency at the sample rate
+void RipplerXAudioProcessor::allocateTubes(double srate)
+{
+    auto length = Waveguide::tubeLength(srate);
+    auto stride = Waveguide::arenaLength(length);
+    if ((int)tubes.size() == globals::MAX_POLYPHONY * 2 * stride)
+        return;
+    tubes.assign(globals::MAX_POLYPHONY * 2 * stride, 0.0);
+    for (int i = 0; i < globals::MAX_POLYPHONY; ++i) {
+        voices[i].resA.waveguide.setTube(&tubesA, i, &tubes[(i * 2) * stride], length);
+        voices[i].resB.waveguide.setTube(&tubesB, i, &tubes[(i * 2 + 1) * stride], length);
+    }
+}
+
+// runs the engine at the host rate or at the host rate divided by a power of two down to 44.1 or 48kHz,
+// called from prepareToPlay only as the comb and limiter are sized for the engine rate
+void RipplerXAudioProcessor::setEngineRate(double hostRate)
+{
+    rateFactor = fixedRate ? Resampler::factorFor(hostRate) : 1;
+    ratePhase = 0;
+    engineRate = hostRate / rateFactor;
+    resamplerIn.setFactor(rateFactor);
+    resamplerL.setFactor(rateFactor);
+    resamplerR.setFactor(rateFactor);
+    totalSamplesBend = (int)(globals::BEND_GLIDE_MS * 0.001 * engineRate);
+    comb.init(engineRate);
+    limiter.init(engineRate);
+    aCutBus.setRamp((int)(0.005 * engineRate)); // glide the shared cut filters on param changes
+    bCutBus.setRamp((int)(0.005 * engineRate));
+    quietSamples = 0;
+}
+
+// with multirate on the resonators output lags Resonator::LAG samples, twice when A feeds B,
+// every output is delayed to the longest lag so the latency does not depend on the coupling params
+int RipplerXAudioProcessor::resonatorLag() const
+{
+    return multiratePartials ? 2 * Resonator::LAG : 0;
+}
+
+// the limiter look-ahead and the direct output delay run at the engine rate, the output resampler adds its delay at the host rate
+int RipplerXAudioProcessor::engineLatency() const
+{
+    return (limiter.getLatency() + dryDelay.getLength()) * rateFactor + resamplerL.getLatency();
+}
+
+// called from prepareToPlay, the latency only changes when the engine is prepared
+// the delays are also kept in seconds for getTailLengthSeconds() which the host may call from any thread
+void RipplerXAudioProcessor::reportLatency()
+{
+    auto latency = engineLatency();
+    delaySeconds = (comb.getDelay() * rateFactor + latency) / (engineRate * rateFactor);
+    setLatencySamples(latency);
+}
+
+// keeps the mallet sample of the voices ringing with the previous program before the shared sample is replaced,
+// a voice still playing an older held sample is cut as only one previous sample is kept
+void RipplerXAudioProcessor::holdMalletSample()
+{
+    for (int i = 0; i < numVoices; ++i)
+        if (voices[i].mallet.isPlaying(heldSampler))
+            voices[i].mallet.clear();
+
+    heldSampler.swap(*malletSampler);
+    heldSampler.pitchfactor = malletSampler->pitchfactor;
+
+    for (int i = 0; i < numVoices; ++i)
+        if (voices[i].mallet.isPlaying(*malletSampler))
+            voices[i].mallet.holdSample(heldSampler);
+}
+
+void RipplerXAudioProcessor::loadExcitation()
+{
+    for (int i = 0; i < globals::MAX_POLYPHONY; ++i) {
+        if (i < numVoices)
+            excitation.load(voices[i], i);
+        else
+            excitation.deactivate(i);
+    }
+}
+
+void RipplerXAudioProcessor::storeExcitation()
+{
+    for (int i = 0; i < numVoices; ++i)
+        excitation.store(voices[i], i);
+}
+
+// Switches between the per voice and the shared cut filters without dropping what rings in them,
+// the filters are linear so the shared filter taking over starts from the sum of the voice filters states,
+// and when the voices take over from silence the shared filter rings out its state with no input
+void RipplerXAudioProcessor::switchCutBus(bool cutBusA, bool cutBusB)
+{
+    auto handOver = [this](bool on, bool& busOn, bool& busTail, Filter& bus, Resonator Voice::* res) {
+        if (on == busOn)
+            return;
+        busOn = on;
+        busTail = !on;
+        if (on) {
+            for (int k = 0; k < numActiveVoices; ++k) {
+                Voice& voice = voices[activeVoices[k]];
+                auto& resonator = voice.*res;
+                if (resonator.on && resonator.cut != 0.0) // the voice fade applies after its filter
+                    bus.addState(0, resonator.filter, 0, voice.isFading ? (double)voice.fadeSamples / voice.fadeTotalSamples : 1.0);
+            }
+        }
+        for (int i = 0; i < globals::MAX_POLYPHONY; ++i)
+            (voices[i].*res).filter.clear();
+    };
+    handOver(cutBusA, cutBusAOn, cutTailA, aCutBus, &Voice::resA);
+    handOver(cutBusB, cutBusBOn, cutTailB, bCutBus, &Voice::resB);
 }
 
 //==============================================================================
@@ -869,65 +1383,139 @@ juce::AudioProcessorEditor* RipplerXAudioProcessor::createEditor()
 //==============================================================================
 void RipplerXAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    auto mallet_type = (int)params.getRawParameterValue("mallet_type")->load();
-    auto state = params.copyState();
-    state.setProperty("currentProgram", currentProgram, nullptr);
-
-    if (mallet_type == kUserFile && malletSampler->isUserFile) {
-        juce::MemoryOutputStream mo;
-        for (auto s : malletSampler->waveform)
-            mo.writeDouble(s);
-
-        state.setProperty("userSample", mo.getMemoryBlock().toBase64Encoding(), nullptr);
+    // hosts request the state often for autosave and undo snapshots
+    // only serialize again when a param or the user sample changed since the last call
+    if (stateChanged.exchange(false) || stateCache.isEmpty()) {
+        stateCache.reset();
+        writeBinaryState(stateCache);
     }
 
-    std::unique_ptr<juce::XmlElement>xml(state.createXml());
-    copyXmlToBinary(*xml, destData);
+    destData.replaceAll(stateCache.getData(), stateCache.getSize());
 }
 
 void RipplerXAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    std::unique_ptr<juce::XmlElement>xmlState (getXmlFromBinary (data, sizeInBytes));
-    if (xmlState.get() != nullptr) {
-        if (xmlState->hasTagName(params.state.getType())) {
-            auto state = juce::ValueTree::fromXml (*xmlState);
-
-            if (state.hasProperty("userSample")) {
-                auto encoded = state.getProperty("userSample").toString();
-                malletSampler->loadEncoded(encoded);
-                state.removeProperty("userSample", nullptr);
-            }
-
-            if (state.hasProperty("currentProgram")) {
-                currentProgram = static_cast<int>(state.getProperty("currentProgram"));
-            }
-            // migrate a_cut and b_cut to new normalized range
-            auto a_cut = state.getChildWithProperty("id", "a_cut");
-            if (a_cut.isValid()) {
-                float val = (float)a_cut.getProperty("value");
-                if (val >= 20.0f) {
-                    val = std::log(val / 20.0f) / std::log(20000.0f / 20.0f);
-                    a_cut.setProperty("value", val, nullptr);
+    if (!readBinaryState(data, sizeInBytes)) {
+        std::unique_ptr<juce::XmlElement>xmlState (getXmlFromBinary (data, sizeInBytes));
+        if (xmlState.get() != nullptr) {
+            if (xmlState->hasTagName(params.state.getType())) {
+                auto state = juce::ValueTree::fromXml (*xmlState);
+
+                if (state.hasProperty("userSample")) {
+                    auto sampler = new Sampler();
+                    sampler->loadEncoded(state.getProperty("userSample").toString());
+                    userSampleData = sampler->getData();
+                    pushCommand({ CommandType::SwapSample, 0, sampler });
+                    state.removeProperty("userSample", nullptr);
                 }
-            }
-            auto b_cut = state.getChildWithProperty("id", "b_cut");
-            if (b_cut.isValid()) {
-                float val = (float)b_cut.getProperty("value");
-                if (val >= 20.0f) {
-                    val = std::log(val / 20.0f) / std::log(20000.0f / 20.0f);
-                    b_cut.setProperty("value", val, nullptr);
+
+                if (state.hasProperty("currentProgram")) {
+                    currentProgram = static_cast<int>(state.getProperty("currentProgram"));
                 }
-            }
 
-            params.replaceState(state);
+                Presets::migrateCutValues(state);
+                params.replaceState(state);
+            }
         }
     }
 
-    resetLastModels();
-    clearVoices();
+    stateChanged = true;
+    pushCommand({ CommandType::ResetLastModels, 0, nullptr });
+    pushCommand({ CommandType::ClearVoices, 0, nullptr });
+}
+
+// Binary state layout:
+// magic, version, current program, num params, [param id, param value]..., user sample size, user sample data
+void RipplerXAudioProcessor::writeBinaryState(juce::MemoryBlock& destData)
+{
+    juce::MemoryOutputStream mo(destData, false);
+    mo.writeInt(BINARY_STATE_MAGIC);
+    mo.writeInt(BINARY_STATE_VERSION);
+    mo.writeInt(currentProgram);
+
+    auto& parameters = getParameters();
+    mo.writeInt(parameters.size());
+    for (auto* param : parameters) {
+        auto* ranged = static_cast<juce::RangedAudioParameter*>(param);
+        mo.writeString(ranged->getParameterID());
+        mo.writeFloat(ranged->convertFrom0to1(ranged->getValue()));
+    }
+
+    if (hasUserSample()) {
+        mo.writeInt64((juce::int64)userSampleData.getSize());
+        mo.write(userSampleData.getData(), userSampleData.getSize());
+    }
+    else {
+        mo.writeInt64(0);
+    }
+}
+
+bool RipplerXAudioProcessor::readBinaryState(const void* data, int sizeInBytes)
+{
+    juce::MemoryInputStream mi(data, (size_t)sizeInBytes, false);
+    if (sizeInBytes < 8 || mi.readInt() != BINARY_STATE_MAGIC)
+        return false;
+    if (mi.readInt() > BINARY_STATE_VERSION)
+        return false;
+
+    currentProgram = mi.readInt();
+
+    auto numParams = mi.readInt();
+    for (int i = 0; i < numParams && !mi.isExhausted(); ++i) {
+        auto id = mi.readString();
+        auto value = mi.readFloat();
+        if (auto* param = params.getParameter(id))
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+    }
+
+    auto sampleSize = mi.readInt64();
+    if (sampleSize > 0 && sampleSize <= mi.getNumBytesRemaining()) {
+        userSampleData.setSize((size_t)sampleSize);
+        mi.read(userSampleData.getData(), (int)sampleSize);
+        auto sampler = new Sampler();
+        sampler->loadData(userSampleData);
+        pushCommand({ CommandType::SwapSample, 0, sampler });
+    }
+
+    return true;
+}
+
+// Creates an xml version of the state used to export patches
+std::unique_ptr<juce::XmlElement> RipplerXAudioProcessor::getStateXml()
+{
+    auto state = params.copyState();
+    state.setProperty("currentProgram", currentProgram, nullptr);
+
+    if (hasUserSample()) {
+        state.setProperty("userSample", userSampleData.toBase64Encoding(), nullptr);
+    }
+
+    return state.createXml();
+}
+
+// the user sample is saved with the state while the mallet plays a user file,
+// decided from the message thread copy instead of the sampler owned by the audio thread
+bool RipplerXAudioProcessor::hasUserSample()
+{
+    auto mallet_type = (int)params.getRawParameterValue("mallet_type")->load();
+    return mallet_type == kUserFile && !userSampleData.isEmpty();
+}
+
+// Decodes the sample in the message thread and sends it to the audio thread
+void RipplerXAudioProcessor::loadMalletSample(juce::String path)
+{
+    auto sampler = new Sampler();
+    sampler->loadSample(path);
+    if (sampler->isUserFile)
+        userSampleData = sampler->getData();
+    else
+        userSampleData.reset(); // the file could not be read, the sampler fell back to an internal sample
+    pushCommand({ CommandType::SwapSample, 0, sampler });
+    stateChanged = true;
 }
 
 // Reset last models and last partials so they don't trigger changes onSlider()
+// reads and writes the audio thread state, other threads send a ResetLastModels command
 void RipplerXAudioProcessor::resetLastModels()
 {
     last_a_model = (int)params.getRawParameterValue("a_model")->load();
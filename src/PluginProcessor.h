@@ -17,6 +17,12 @@
 #include "dsp/Models.h"
 #include "dsp/Mallet.h"
 #include "dsp/Sampler.h"
+#include "dsp/Fifo.h"
+#include "dsp/Excitation.h"
+#include "dsp/Resampler.h"
+#include "dsp/Delay.h"
+#include "dsp/Kernels.h"
+#include "Presets.h"
 #include "libMTSClient.h"
 
 enum MIDIMsgType 
@@ -36,6 +42,113 @@ struct MIDIMsg
     int vel;
 };
 
+enum CommandType
+{
+    SetPolyphony,
+    ClearVoices,
+    SwapSample,
+    ResetLastModels,
+};
+
+// Engine changes sent from the message thread to the audio thread
+// processed commands are sent back so that any data they own is freed outside the audio thread
+struct Command
+{
+    CommandType type;
+    int value;
+    Sampler* sampler; // SwapSample: decoded sample, holds the previous sample when sent back
+};
+
+// Output levels of one block, sent to the editor meter
+struct MeterLevels
+{
+    float peakL;
+    float peakR;
+    float rmsL;
+    float rmsR;
+    int numSamples;
+};
+
+// Params read once per block by the render kernels
+struct RenderParams
+{
+    const juce::NormalisableRange<float>& noise_mix_range;
+    const juce::NormalisableRange<float>& noise_res_range;
+    double bend_range;
+};
+
+// Params resolved by onSlider() and applied to each voice
+struct VoiceParams
+{
+    double srate = 44100.0;
+    MalletType mallet_type = MalletType::kImpulse;
+    double mallet_filter = 0.0;
+
+    int noise_filter_mode = 0;
+    double noise_filter_freq = 20.0;
+    double noise_filter_q = 0.707;
+    double noise_att = 1.0;
+    double noise_dec = 500.0;
+    double noise_sus = 0.0;
+    double noise_rel = 500.0;
+    double noise_att_ten = 0.0;
+    double noise_dec_ten = 0.0;
+    double noise_rel_ten = 0.0;
+    double vel_noise_freq = 0.0;
+    double vel_noise_q = 0.0;
+    double vel_noise_att = 0.0;
+    double vel_noise_dec = 0.0;
+    double vel_noise_sus = 0.0;
+    double vel_noise_rel = 0.0;
+
+    bool a_on = false;
+    int a_model = 0;
+    int a_partials = 0;
+    double a_decay = 1.0;
+    double a_damp = 0.0;
+    double a_tone = 0.0;
+    double a_hit = 0.0;
+    double a_rel = 1.0;
+    double a_inharm = 0.0001;
+    double a_ratio = 1.0;
+    double a_cut = 0.0;
+    double a_radius = 0.0;
+    double vel_a_decay = 0.0;
+    double vel_a_hit = 0.0;
+    double vel_a_inharm = 0.0;
+    double vel_a_damp = 0.0;
+    double vel_a_tone = 0.0;
+    double a_coarse = 0.0;
+    double a_fine = 0.0;
+
+    bool b_on = false;
+    int b_model = 0;
+    int b_partials = 0;
+    double b_decay = 1.0;
+    double b_damp = 0.0;
+    double b_tone = 0.0;
+    double b_hit = 0.0;
+    double b_rel = 1.0;
+    double b_inharm = 0.0001;
+    double b_ratio = 1.0;
+    double b_cut = 0.0;
+    double b_radius = 0.0;
+    double vel_b_decay = 0.0;
+    double vel_b_hit = 0.0;
+    double vel_b_inharm = 0.0;
+    double vel_b_damp = 0.0;
+    double vel_b_tone = 0.0;
+    double b_coarse = 0.0;
+    double b_fine = 0.0;
+
+    bool couple = false;
+    double split = 0.0;
+    bool harmonic_tubes = false; // render harmonic models with the waveguides
+    bool multirate = false; // run the low partials at half or quarter rate
+    double max_bend = 1.0; // pitch bend factor at the top of the bend range
+    VoiceMix mix{};
+};
+
 //==============================================================================
 /**
 */
@@ -43,16 +156,19 @@ class RipplerXAudioProcessor  : public juce::AudioProcessor, public juce::AudioP
 {
 public:
     float scale = 1.0f; // UI scale
-    int polyphony = 8;
+    int polyphony = 8; // polyphony setting, the audio thread uses numVoices
     bool velMap = false; // config used by UI to set velocity edit mode
     bool darkTheme = false;
+    bool limiterLookahead = false; // limiter look-ahead setting, changes the latency so it is applied by prepareToPlay
+    bool multiratePartials = false; // multirate setting, changes the latency so it is applied by prepareToPlay
+    bool fixedRate = false; // run the engine at 44.1 or 48kHz and resample it to the host rate, applied by prepareToPlay
     int last_a_model = -1;
     int last_b_model = -1;
     int last_a_partials = -1;
     int last_b_partials = -1;
     int currentProgram = -1;
     int totalSamplesBend = 0;
-    std::atomic<float> rmsValue { 0.0f };
+    Fifo<MeterLevels, 256> meterLevels; // audio thread to editor meter
     MTSClient *mtsClientPtr;
     MalletType l_mallet_type = MalletType::kImpulse; // used to detect mallet type changes
     bool sustainPedal = false;
@@ -84,7 +200,8 @@ public:
     int pickVoice (int note);
     void onNote (MIDIMsg msg);
     void offNote (MIDIMsg msg);
-    void onSlider ();
+    void onSlider (bool programChange = false);
+    void applyVoiceParams (Voice& voice);
     void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
     template <typename FloatType>
@@ -114,11 +231,20 @@ public:
     //==============================================================================
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
+    std::unique_ptr<juce::XmlElement> getStateXml();
+    void loadMalletSample(juce::String path);
+    bool hasUserSample();
 
     void loadSettings();
     void saveSettings();
     void setPolyphony(int value);
+    void pushCommand(Command command);
+    void processCommands();
     void setScale(float value);
+    void setLimiterLookahead(bool value);
+    void setMultiratePartials(bool value);
+    void setFixedRate(bool value);
+    void prepareAgain();
 
     juce::MidiKeyboardState keyboardState;
     juce::AudioProcessorValueTreeState params;
@@ -126,14 +252,82 @@ public:
 
     std::unique_ptr<Sampler> malletSampler;
 private:
+    Sampler heldSampler; // previous mallet sample, played by the voices ringing with the previous program
     bool paramChanged = false; // flag that triggers on any param change
+    int numVoices = 8; // active polyphony, owned by the audio thread
+    Fifo<Command, 64> commands; // message thread to audio thread
+    juce::CriticalSection commandLock; // serializes the producers, the host may set the state from a worker thread
+    Fifo<Command, 64> commandResults; // audio thread to message thread
+    std::atomic<bool> programChanged { false }; // the pending param changes come from a program change
+    juce::CriticalSection programLock; // held while a program writes its params, onSlider() never sees part of a program
+    VoiceParams voiceParams{};
+    std::atomic<bool> stateChanged { true }; // invalidates the cached state on any param or sample change
+    juce::MemoryBlock stateCache; // last serialized state returned to the host
+    juce::MemoryBlock userSampleData; // encoded user sample, written once per sample load
     juce::ApplicationProperties settings;
     std::vector<MIDIMsg> midi;
     std::vector<MIDIMsg> sustainPedalNotes;
-    std::vector<std::unique_ptr<Voice>> voices;
+    std::vector<Voice> voices; // one contiguous block, reserved once so the voices never move
+    std::vector<double> tubes; // waveguide delay lines of all voices in one block
+    WaveguideLanes tubesA{}; // waveguide state of the A resonators, one lane per voice
+    WaveguideLanes tubesB{};
     std::unique_ptr<Models> models;
+    std::unique_ptr<Presets> presets;
     Comb comb{};
     Limiter limiter{};
+    Filter aCutBus{}; // shared cut filter of resonator A output
+    Filter bCutBus{}; // shared cut filter of resonator B output
+    bool cutBusAOn = false;
+    bool cutBusBOn = false;
+    bool cutTailA = false; // the shared cut filter rings out its state after the voice filters take over
+    bool cutTailB = false;
+    Excitation excitation{};
+    Delay<2 * Resonator::LAG> dryDelay{ 0 }; // direct output delayed by the B resonators lag with multirate on
+    Delay<Resonator::LAG> aLagDelay{ 0 }; // A output delayed to the same lag
+    std::vector<double> inMix; // audio input downmixed to mono
+    std::vector<double> outL; // output block before the limiter
+    std::vector<double> outR;
+    std::vector<double> hostL; // output block resampled to the host rate
+    std::vector<double> hostR;
+    int blockSize = 1; // samples per block announced by prepareToPlay, larger blocks are processed in chunks of this size
+    juce::MidiBuffer chunkMidi; // midi of the current chunk of a larger block
+    std::atomic<double> delaySeconds { 0.0 }; // comb delay and latency, part of the tail length
+    int rateFactor = 1; // host samples per engine sample
+    int ratePhase = 0; // host samples since the last engine sample
+    double engineRate = 44100.0;
+    Resampler resamplerIn{}; // audio input to the engine rate
+    Resampler resamplerL{}; // output to the host rate
+    Resampler resamplerR{};
+    int activeVoices[globals::MAX_POLYPHONY]{}; // indexes of the voices that may be sounding, in ascending order
+    int numActiveVoices = 0;
+    int quietSamples = 0; // consecutive samples of silence written to the comb and limiter
+    bool wasNonRealtime = false; // the last block was rendered offline
+    juce::int64 renderTime = 0; // transport position of the last offline block
+    static constexpr double IDLE_THRESHOLD = 1e-8; // output level below which the instance counts as silent
+    static constexpr double CUT_TOLERANCE = 1e-6; // max cut difference between voices to share the cut filter
+
+    void writeBinaryState(juce::MemoryBlock& destData);
+    bool readBinaryState(const void* data, int sizeInBytes);
+    void switchCutBus(bool cutBusA, bool cutBusB);
+    void loadExcitation();
+    void storeExcitation();
+    bool isIdle(int numSamples) const;
+    void setBendTarget(double pitchWheel, double bendRange);
+    void interpolatePitchBend();
+
+    using RenderKernel = void (RipplerXAudioProcessor::*)(int numSamples, const RenderParams& rp);
+    static const RenderKernel renderKernels[2][2][2]; // [cutBusA][cutBusB][noiseOsc]
+    template <bool CutBusA, bool CutBusB, bool NoiseOsc>
+    void renderBlock(int numSamples, const RenderParams& rp);
+    void activateVoice(int index);
+    void allocateTubes(double srate);
+    void setEngineRate(double hostRate);
+    void holdMalletSample();
+    int resonatorLag() const;
+    int engineLatency() const;
+    void reportLatency();
+    void sweepVoices();
+    void seedNoise(bool deterministic);
     
 
 
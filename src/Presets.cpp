@@ -0,0 +1,140 @@
+// Copyright 2025 tilr
+
+#include "Presets.h"
+
+struct PresetData
+{
+    const char* name;
+    const char* data;
+    int size;
+};
+
+static const PresetData presetData[Presets::NUM_PRESETS] = {
+    { "Init", BinaryData::Init_xml, BinaryData::Init_xmlSize },
+    { "Harpsi", BinaryData::Harpsi_xml, BinaryData::Harpsi_xmlSize },
+    { "Harp", BinaryData::Harp_xml, BinaryData::Harp_xmlSize },
+    { "Sankyo", BinaryData::Sankyo_xml, BinaryData::Sankyo_xmlSize },
+    { "Tubes", BinaryData::Tubes_xml, BinaryData::Tubes_xmlSize },
+    { "Stars", BinaryData::Stars_xml, BinaryData::Stars_xmlSize },
+    { "DoorBell", BinaryData::DoorBell_xml, BinaryData::DoorBell_xmlSize },
+    { "Bells", BinaryData::Bells_xml, BinaryData::Bells_xmlSize },
+    { "Bells2", BinaryData::Bells2_xml, BinaryData::Bells2_xmlSize },
+    { "KeyRing", BinaryData::KeyRing_xml, BinaryData::KeyRing_xmlSize },
+    { "Sink", BinaryData::Sink_xml, BinaryData::Sink_xmlSize },
+    { "Cans", BinaryData::Cans_xml, BinaryData::Cans_xmlSize },
+    { "Gong", BinaryData::Gong_xml, BinaryData::Gong_xmlSize },
+    { "Bong", BinaryData::Bong_xml, BinaryData::Bong_xmlSize },
+    { "Marimba", BinaryData::Marimba_xml, BinaryData::Marimba_xmlSize },
+    { "Fight", BinaryData::Fight_xml, BinaryData::Fight_xmlSize },
+    { "Tabla", BinaryData::Tabla_xml, BinaryData::Tabla_xmlSize },
+    { "Tabla2", BinaryData::Tabla2_xml, BinaryData::Tabla2_xmlSize },
+    { "Strings", BinaryData::Strings_xml, BinaryData::Strings_xmlSize },
+    { "OldClock", BinaryData::OldClock_xml, BinaryData::OldClock_xmlSize },
+    { "Crystal", BinaryData::Crystal_xml, BinaryData::Crystal_xmlSize },
+    { "Ride", BinaryData::Ride_xml, BinaryData::Ride_xmlSize },
+    { "Ride2", BinaryData::Ride2_xml, BinaryData::Ride2_xmlSize },
+    { "Crash", BinaryData::Crash_xml, BinaryData::Crash_xmlSize },
+    { "Vibes", BinaryData::Vibes_xml, BinaryData::Vibes_xmlSize },
+    { "Flute", BinaryData::Flute_xml, BinaryData::Flute_xmlSize },
+    { "Fifths", BinaryData::Fifths_xml, BinaryData::Fifths_xmlSize },
+    { "Kalimba", BinaryData::Kalimba_xml, BinaryData::Kalimba_xmlSize },
+};
+
+Presets::Presets(juce::AudioProcessorValueTreeState& p)
+    : juce::Thread("RipplerX Presets")
+    , params(p)
+    , stateType(p.state.getType())
+{
+    startThread(juce::Thread::Priority::background);
+}
+
+Presets::~Presets()
+{
+    stopThread(1000);
+}
+
+juce::String Presets::getName(int index)
+{
+    if (index < 0 || index >= NUM_PRESETS) return "";
+    return presetData[index].name;
+}
+
+// migrate a_cut and b_cut from frequency values to the new normalized range
+void Presets::migrateCutValues(juce::ValueTree& state)
+{
+    for (auto id : { "a_cut", "b_cut" }) {
+        auto cut = state.getChildWithProperty("id", id);
+        if (cut.isValid()) {
+            float val = (float)cut.getProperty("value");
+            if (val >= 20.0f) {
+                val = std::log(val / 20.0f) / std::log(20000.0f / 20.0f);
+                cut.setProperty("value", val, nullptr);
+            }
+        }
+    }
+}
+
+// parses every preset ahead of time so that program changes never wait on xml
+void Presets::run()
+{
+    for (int i = 0; i < NUM_PRESETS && !threadShouldExit(); ++i) {
+        get(i);
+    }
+}
+
+// returns the parsed preset, parsing it now if the background thread did not reach it yet
+// presets are never modified after parsed so the reference stays valid outside the lock
+const Presets::Preset& Presets::get(int index)
+{
+    const juce::ScopedLock lock(parseLock);
+    auto& preset = presets[index];
+    if (!preset.parsed) {
+        parse(index, preset);
+        preset.parsed = true;
+    }
+    return preset;
+}
+
+void Presets::parse(int index, Preset& preset)
+{
+    auto& data = presetData[index];
+    auto xmlState = juce::XmlDocument::parse(juce::String(data.data, (size_t)data.size));
+    if (xmlState == nullptr || !xmlState->hasTagName(stateType))
+        return;
+
+    auto state = juce::ValueTree::fromXml(*xmlState);
+    migrateCutValues(state);
+
+    // every param gets a value, those missing from the preset xml go back to their defaults
+    // so that nothing carries over from the previous program
+    for (auto* p : params.processor.getParameters()) {
+        auto* param = dynamic_cast<juce::RangedAudioParameter*>(p);
+        if (param == nullptr) continue;
+        auto child = state.getChildWithProperty("id", param->paramID);
+        auto value = child.isValid() && child.hasProperty("value")
+            ? param->convertTo0to1((float)child.getProperty("value"))
+            : param->getDefaultValue();
+        preset.values.push_back({ param, value });
+    }
+
+    preset.valid = true;
+}
+
+// writes the preset values directly into the params
+// returns false if the preset could not be parsed
+bool Presets::apply(int index)
+{
+    if (index < 0 || index >= NUM_PRESETS)
+        return false;
+
+    auto& preset = get(index);
+    if (!preset.valid)
+        return false;
+
+    for (auto& [param, value] : preset.values) {
+        if (param->getValue() != value)
+            param->setValueNotifyingHost(value);
+    }
+
+    return true;
+}
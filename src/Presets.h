@@ -0,0 +1,47 @@
+// Copyright 2025 tilr
+// Factory presets cache
+// parses the embedded presets once in a background thread into lists of normalized param values
+// so that switching programs only writes the params instead of parsing xml and replacing the state
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <vector>
+
+class Presets : private juce::Thread
+{
+public:
+    static constexpr int NUM_PRESETS = 28;
+
+    Presets(juce::AudioProcessorValueTreeState& params);
+    ~Presets() override;
+
+    static juce::String getName(int index);
+    static void migrateCutValues(juce::ValueTree& state);
+
+    bool apply(int index);
+
+private:
+    struct ParamValue
+    {
+        juce::RangedAudioParameter* param;
+        float value; // normalized
+    };
+
+    struct Preset
+    {
+        bool parsed = false;
+        bool valid = false;
+        std::vector<ParamValue> values;
+    };
+
+    void run() override;
+    const Preset& get(int index);
+    void parse(int index, Preset& preset);
+
+    juce::AudioProcessorValueTreeState& params;
+    juce::Identifier stateType;
+    juce::CriticalSection parseLock;
+    std::array<Preset, NUM_PRESETS> presets;
+};
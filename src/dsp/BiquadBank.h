@@ -0,0 +1,232 @@
+// Copyright 2025 tilr
+// Bank of N biquad filters in transposed direct form II with RBJ lp, bp and hp designs
+// the filters can run in parallel (one sample for each filter, vectorized across filters)
+// or in series as a cascade, coefficient changes can be ramped over a number of samples
+
+#pragma once
+#include <cmath>
+#include <type_traits>
+#include "JuceHeader.h"
+#include "Kernels.h"
+
+template <typename T, int N>
+class BiquadBank
+{
+public:
+	BiquadBank() { clear(); };
+	~BiquadBank() {};
+
+	void lp(double srate, double freq, double q, int i = 0)
+	{
+		auto w0 = juce::MathConstants<double>::twoPi * fmin(freq / srate, 0.49);
+		auto alpha = sin(w0) / (2.0 * q);
+		auto scale = 1.0 / (1.0 + alpha);
+		auto _a1 = cos(w0) * -2.0 * scale;
+		auto _a2 = (1.0 - alpha) * scale;
+		auto _b0 = (1.0 + _a1 + _a2) * 0.25;
+		setCoefs((T)_b0, (T)(_b0 * 2.0), (T)_b0, (T)_a1, (T)_a2, i);
+	}
+
+	void bp(double srate, double freq, double q, int i = 0)
+	{
+		auto w0 = juce::MathConstants<double>::twoPi * fmin(freq / srate, 0.49);
+		auto alpha = sin(w0) / (2.0 * q);
+		auto scale = 1.0 / (1.0 + alpha);
+		auto _a1 = cos(w0) * -2.0 * scale;
+		auto _a2 = (1.0 - alpha) * scale;
+		auto _b0 = (1.0 - _a2) * 0.5 * q;
+		setCoefs((T)_b0, (T)0.0, (T)-_b0, (T)_a1, (T)_a2, i);
+	}
+
+	void hp(double srate, double freq, double q, int i = 0)
+	{
+		auto w0 = juce::MathConstants<double>::twoPi * fmin(freq / srate, 0.49);
+		auto alpha = sin(w0) / (2.0 * q);
+		auto scale = 1.0 / (1.0 + alpha);
+		auto _a1 = cos(w0) * -2.0 * scale;
+		auto _a2 = (1.0 - alpha) * scale;
+		auto _b0 = (1.0 - _a1 + _a2) * 0.25;
+		setCoefs((T)_b0, (T)(_b0 * -2.0), (T)_b0, (T)_a1, (T)_a2, i);
+	}
+
+	// sets the normalized coefficients (a0 = 1) of filter i, ramped if a ramp length is set
+	void setCoefs(T _b0, T _b1, T _b2, T _a1, T _a2, int i = 0)
+	{
+		if (rampLength <= 0) {
+			if (rampLeft[i] > 0) {
+				rampLeft[i] = 0;
+				--ramping;
+			}
+			b0[i] = _b0; b1[i] = _b1; b2[i] = _b2; a1[i] = _a1; a2[i] = _a2;
+			return;
+		}
+
+		// linear interpolation between two stable biquads stays stable, the stability triangle is convex
+		auto inv = (T)1 / (T)rampLength;
+		tb0[i] = _b0; tb1[i] = _b1; tb2[i] = _b2; ta1[i] = _a1; ta2[i] = _a2;
+		db0[i] = (_b0 - b0[i]) * inv;
+		db1[i] = (_b1 - b1[i]) * inv;
+		db2[i] = (_b2 - b2[i]) * inv;
+		da1[i] = (_a1 - a1[i]) * inv;
+		da2[i] = (_a2 - a2[i]) * inv;
+		if (rampLeft[i] == 0) ++ramping;
+		rampLeft[i] = rampLength;
+	}
+
+	// number of samples the coefficients take to reach new values, 0 applies them immediately
+	void setRamp(int samples) { rampLength = samples; }
+
+	void copyCoefs(const BiquadBank& src)
+	{
+		for (int i = 0; i < N; ++i) {
+			b0[i] = src.b0[i]; b1[i] = src.b1[i]; b2[i] = src.b2[i]; a1[i] = src.a1[i]; a2[i] = src.a2[i];
+			rampLeft[i] = 0;
+		}
+		ramping = 0;
+	}
+
+	// copies the coefficients and state of a filter from another bank
+	template <int M>
+	void copyLane(int i, const BiquadBank<T, M>& src, int srcLane)
+	{
+		b0[i] = src.b0[srcLane]; b1[i] = src.b1[srcLane]; b2[i] = src.b2[srcLane];
+		a1[i] = src.a1[srcLane]; a2[i] = src.a2[srcLane];
+		s1[i] = src.s1[srcLane]; s2[i] = src.s2[srcLane];
+	}
+
+	// adds the state of a filter from another bank, filters with the same coefficients
+	// output the sum of their outputs when their states are summed since they are linear
+	template <int M>
+	void addState(int i, const BiquadBank<T, M>& src, int srcLane, T gain = (T)1)
+	{
+		s1[i] += src.s1[srcLane] * gain;
+		s2[i] += src.s2[srcLane] * gain;
+	}
+
+	// magnitude of the state of filter i, its output with no input decays from it
+	T stateLevel(int i = 0) const { return std::abs(s1[i]) + std::abs(s2[i]); }
+
+	// sets the state of all filters as if the input had been constant
+	void clear(T input = 0)
+	{
+		for (int i = 0; i < N; ++i)
+			clearLane(i, input);
+	}
+
+	void clearLane(int i, T input = 0)
+	{
+		auto den = (T)1 + a1[i] + a2[i];
+		auto y = den != (T)0 ? input * (b0[i] + b1[i] + b2[i]) / den : (T)0;
+		s2[i] = b2[i] * input - a2[i] * y;
+		s1[i] = b1[i] * input - a1[i] * y + s2[i];
+	}
+
+	// processes one sample with filter i
+	T process(T x, int i = 0)
+	{
+		if (ramping) advanceRamp(i);
+		auto y = b0[i] * x + s1[i];
+		s1[i] = b1[i] * x - a1[i] * y + s2[i];
+		s2[i] = b2[i] * x - a2[i] * y;
+		return y;
+	}
+
+	// processes a block in place with filter i
+	void processBlock(T* data, int n, int i = 0)
+	{
+		for (int k = 0; k < n; ++k)
+			data[k] = process(data[k], i);
+	}
+
+	// processes one sample for each filter
+	void processParallel(const T* in, T* out)
+	{
+		if (ramping) advanceRamps();
+		if constexpr (std::is_same_v<T, double>) {
+			Kernels::get().biquadParallel(b0, b1, b2, a1, a2, s1, s2, in, out, nullptr, N);
+			return;
+		}
+		for (int i = 0; i < N; ++i) {
+			auto x = in[i];
+			auto y = b0[i] * x + s1[i];
+			s1[i] = b1[i] * x - a1[i] * y + s2[i];
+			s2[i] = b2[i] * x - a2[i] * y;
+			out[i] = y;
+		}
+	}
+
+	// processes one sample for each filter, filters with active == 0 keep their state
+	void processParallel(const T* in, T* out, const T* active)
+	{
+		if (ramping) advanceRamps();
+		if constexpr (std::is_same_v<T, double>) {
+			Kernels::get().biquadParallel(b0, b1, b2, a1, a2, s1, s2, in, out, active, N);
+			return;
+		}
+		for (int i = 0; i < N; ++i) {
+			auto x = in[i];
+			auto y = b0[i] * x + s1[i];
+			auto ns1 = b1[i] * x - a1[i] * y + s2[i];
+			auto ns2 = b2[i] * x - a2[i] * y;
+			bool on = active[i] != (T)0;
+			s1[i] = on ? ns1 : s1[i];
+			s2[i] = on ? ns2 : s2[i];
+			out[i] = y;
+		}
+	}
+
+	// runs one sample through all filters in series
+	T processSerial(T x)
+	{
+		if (ramping) advanceRamps();
+		for (int i = 0; i < N; ++i) {
+			auto y = b0[i] * x + s1[i];
+			s1[i] = b1[i] * x - a1[i] * y + s2[i];
+			s2[i] = b2[i] * x - a2[i] * y;
+			x = y;
+		}
+		return x;
+	}
+
+	void processSerialBlock(T* data, int n)
+	{
+		for (int k = 0; k < n; ++k)
+			data[k] = processSerial(data[k]);
+	}
+
+private:
+	template <typename, int> friend class BiquadBank;
+
+	alignas(32) T b0[N] = {};
+	alignas(32) T b1[N] = {};
+	alignas(32) T b2[N] = {};
+	alignas(32) T a1[N] = {};
+	alignas(32) T a2[N] = {};
+	alignas(32) T s1[N] = {};
+	alignas(32) T s2[N] = {};
+
+	// coefficient ramps
+	int rampLength = 0;
+	int ramping = 0; // number of filters ramping
+	int rampLeft[N] = {};
+	T tb0[N] = {}, tb1[N] = {}, tb2[N] = {}, ta1[N] = {}, ta2[N] = {}; // targets
+	T db0[N] = {}, db1[N] = {}, db2[N] = {}, da1[N] = {}, da2[N] = {}; // steps
+
+	void advanceRamp(int i)
+	{
+		if (rampLeft[i] == 0) return;
+		if (--rampLeft[i] == 0) {
+			b0[i] = tb0[i]; b1[i] = tb1[i]; b2[i] = tb2[i]; a1[i] = ta1[i]; a2[i] = ta2[i];
+			--ramping;
+		}
+		else {
+			b0[i] += db0[i]; b1[i] += db1[i]; b2[i] += db2[i]; a1[i] += da1[i]; a2[i] += da2[i];
+		}
+	}
+
+	void advanceRamps()
+	{
+		for (int i = 0; i < N; ++i)
+			advanceRamp(i);
+	}
+};
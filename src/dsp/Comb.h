@@ -1,8 +1,8 @@
 // Copyright (C) 2025 tilr
 // Comb stereoizer
 #pragma once
-#include <tuple>
 #include <vector>
+#include <algorithm>
 
 class Comb
 {
@@ -13,21 +13,31 @@ public:
   void init(double srate)
   {
     pos = 0;
-    buf.resize((int)(20 * srate / 1000));
-    std::fill(buf.begin(), buf.end(), 0.0);
+    delay = (int)(20 * srate / 1000) - 1;
+    int size = 1;
+    while (size <= delay) size <<= 1; // power of two size so positions wrap with a mask
+    mask = size - 1;
+    buf.assign(size, 0.0);
   }
 
-  std::tuple<double, double> process(double input) {
-    buf[pos] = input;
-    pos = (pos + 1) % buf.size();
+  int getDelay() const { return delay; }
 
-    return std::tuple<double, double>(
-      input + buf[pos] * 0.33,
-      input - buf[pos] * 0.33
-    );
+  // spreads a mono block into left and right, input may be the same array as left
+  void process(const double* input, double* left, double* right, int n)
+  {
+    for (int i = 0; i < n; ++i) {
+      auto x = input[i];
+      buf[pos] = x;
+      auto d = buf[(pos - delay) & mask] * 0.33;
+      left[i] = x + d;
+      right[i] = x - d;
+      pos = (pos + 1) & mask;
+    }
   }
 
 private:
   int pos = 0;
+  int delay = 0;
+  int mask = 0;
   std::vector<double> buf;
-};
\ No newline at end of file
+};
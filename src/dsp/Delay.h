@@ -0,0 +1,45 @@
+// Copyright 2025 tilr
+// Delay line of up to Size samples stored inline, the length is set off the per sample path
+// used to line up the multirate partials bands, and the resonators and direct outputs to the longest resonator lag
+
+#pragma once
+#include <algorithm>
+#include <iterator>
+
+template <int Size>
+class Delay
+{
+public:
+	Delay(int _length = Size) : length(std::max(0, std::min(_length, Size))) {};
+	~Delay() {};
+
+	// delay in samples, the line starts from silence
+	void setLength(int _length)
+	{
+		length = std::max(0, std::min(_length, Size));
+		clear();
+	}
+
+	int getLength() const { return length; }
+
+	void clear()
+	{
+		std::fill(std::begin(x), std::end(x), 0.0);
+		pos = 0;
+	}
+
+	// writes a sample and returns the one written length samples ago, a zero length passes it through
+	double process(double input)
+	{
+		if (length == 0) return input;
+		auto y = x[pos];
+		x[pos] = input;
+		pos = pos + 1 == length ? 0 : pos + 1;
+		return y;
+	}
+
+private:
+	double x[Size] = {};
+	int length = 0;
+	int pos = 0;
+};
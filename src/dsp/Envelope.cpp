@@ -1,5 +1,6 @@
 #include "Envelope.h"
 #include "cmath"
+#include <algorithm>
 
 // Normalize tension from [-1,1] to [0.001..1, 100 (linear), 2..1]
 double Envelope::normalizeTension(double t) 
@@ -102,3 +103,79 @@ int Envelope::process()
 	return state;
 }
 
+// renders n samples of the envelope, same as calling process() n times and reading env after each call
+// each segment is rendered in closed form, in the block where it reaches its target
+// the samples from just before the crossing are processed one by one so the state transitions happen as in process()
+// except where the recursion lands within rounding of the target, then a segment may end one sample apart
+// returns the number of samples processed while the envelope was on
+int Envelope::renderBlock(double* out, int n)
+{
+	int i = 0;
+	while (i < n) {
+		if (state == 0 || state == 4) { // off or sustain, the envelope is constant
+			std::fill(out + i, out + n, env);
+			return state ? n : i;
+		}
+
+		auto b = state == 1 ? ab : state == 2 ? db : rb;
+		auto c = state == 1 ? ac : state == 2 ? dc : rc;
+		auto target = state == 1 ? scale : state == 2 ? sus * scale : 0.0;
+
+		auto start = env;
+		renderSegment(out + i, n - i, b, c);
+		// stop short of the target, near it the series and the recursion may round differently
+		auto guard = 1e-9 * (fabs(start) + fabs(target));
+		auto limit = state == 1 ? target - guard : target + guard;
+		auto count = segmentLength(out + i, n - i, limit, state == 1);
+		if (count == n - i)
+			return n;
+
+		count -= 2; // margin for rounding
+		if (count > 0) {
+			env = out[i + count - 1];
+			i += count;
+			continue;
+		}
+		env = start;
+		process();
+		out[i++] = env;
+	}
+	return n;
+}
+
+// number of samples of a rendered segment before it reaches the limit, the segment is monotonic
+int Envelope::segmentLength(const double* out, int n, double limit, bool rising)
+{
+	auto reached = [&](double x) { return rising ? x >= limit : x <= limit; };
+	if (!reached(out[n - 1]))
+		return n;
+	int i = 0;
+	while (!reached(out[i])) ++i;
+	return i;
+}
+
+// env = b + env * c stepped four samples at a time as env = b4 + env * c4, so the four chains vectorize
+// unlike fix + (env - fix) * c^k it stays accurate when c is close to 1 (linear tension)
+void Envelope::renderSegment(double* out, int n, double b, double c)
+{
+	double v[4];
+	auto e = env;
+	for (int k = 0; k < 4; ++k) {
+		e = b + e * c;
+		v[k] = e;
+	}
+	auto c4 = c * c * c * c;
+	auto b4 = b * (1.0 + c + c * c + c * c * c);
+
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		for (int k = 0; k < 4; ++k) {
+			out[i + k] = v[k];
+			v[k] = b4 + v[k] * c4;
+		}
+	}
+	for (int k = 0; i < n; ++i, ++k)
+		out[i] = v[k];
+
+	env = out[n - 1];
+}
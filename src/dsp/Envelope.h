@@ -17,6 +17,7 @@ public:
 	void sustain();
 	void decay();
 	int process();
+	int renderBlock(double* out, int n);
 
 	double att = 0.0;
 	double dec = 0.0;
@@ -40,4 +41,6 @@ private:
 	inline double normalizeTension(double t);
 	std::tuple<double, double> calcCoefs(double targetB1, double targetB2, double targetC, double rate, double tension, double mult);
 	void recalcCoefs(); // calcs coefficients for attack and decay
+	static int segmentLength(const double* out, int n, double limit, bool rising);
+	void renderSegment(double* out, int n, double b, double c);
 };
\ No newline at end of file
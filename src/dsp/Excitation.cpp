@@ -0,0 +1,195 @@
+#include "Excitation.h"
+#include "Voice.h"
+
+Excitation::Excitation()
+{
+	for (int i = 0; i < LANES; ++i)
+		deactivate(i);
+}
+
+// copies the voice mallet and noise state into a lane
+void Excitation::load(Voice& voice, int l)
+{
+	auto& mallet = voice.mallet;
+	countdown[l] = mallet.isImpulse() ? (double)mallet.countdown : 0.0;
+	impulse[l] = mallet.impulse;
+	impulseDecay[l] = mallet.env;
+	malletFilters.copyLane(l, mallet.impulse_filter, 0);
+
+	auto& noise = voice.noise;
+	setSeed(l, noise.rng);
+	filterOn[l] = noise.filter_active ? 1.0 : 0.0;
+	noiseFilters.copyLane(l, noise.filter, 0);
+	setEnvelope(l, noise.env);
+}
+
+// copies a lane back into the voice
+void Excitation::store(Voice& voice, int l)
+{
+	auto& mallet = voice.mallet;
+	if (mallet.isImpulse()) {
+		mallet.countdown = (int)countdown[l];
+		mallet.impulse = impulse[l];
+		mallet.impulse_filter.copyLane(0, malletFilters, l);
+	}
+
+	auto& noise = voice.noise;
+	noise.rng = seed(l);
+	noise.filter.copyLane(0, noiseFilters, l);
+	stored[l] = envelopeAt(l);
+	noise.env = stored[l];
+}
+
+void Excitation::deactivate(int l)
+{
+	countdown[l] = 0.0;
+	setSeed(l, 1);
+	setEnvelope(l, Envelope());
+}
+
+// xorshift32, vectorized across lanes when generating a block
+static inline uint32_t xorshift(uint32_t s)
+{
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return s;
+}
+
+// white noise in [-1, 1) of a generator state
+static inline double noiseValue(uint32_t s)
+{
+	return (double)(int32_t)s * (1.0 / 2147483648.0);
+}
+
+// sets the generator state of a lane, the rest of the block is generated again from it
+void Excitation::setSeed(int l, uint32_t s)
+{
+	if (seed(l) == s)
+		return;
+	seed(l) = s;
+	for (int k = pos; k < BLOCK; ++k) {
+		s = xorshift(s);
+		seeds[k][l] = s;
+		noiseBlock[k][l] = noiseValue(s);
+	}
+}
+
+// generates the next BLOCK samples of white noise of all lanes
+void Excitation::generateNoise()
+{
+	alignas(32) uint32_t s[LANES];
+	for (int l = 0; l < LANES; ++l) {
+		blockSeeds[l] = seeds[BLOCK - 1][l];
+		s[l] = blockSeeds[l];
+	}
+	for (int k = 0; k < BLOCK; ++k) {
+		for (int l = 0; l < LANES; ++l) {
+			s[l] = xorshift(s[l]);
+			seeds[k][l] = s[l];
+			noiseBlock[k][l] = noiseValue(s[l]);
+		}
+	}
+	pos = 0;
+}
+
+static bool sameEnvelope(const Envelope& a, const Envelope& b)
+{
+	return a.state == b.state && a.env == b.env && a.scale == b.scale
+		&& a.att == b.att && a.dec == b.dec && a.sus == b.sus && a.rel == b.rel
+		&& a.ab == b.ab && a.ac == b.ac && a.db == b.db && a.dc == b.dc && a.rb == b.rb && a.rc == b.rc
+		&& a.ta == b.ta && a.td == b.td && a.tr == b.tr;
+}
+
+// sets the envelope state of a lane at the current sample, the rest of the block is rendered again from it
+// unless it is the state the lane stored, then the lane was not changed and its render is still valid
+void Excitation::setEnvelope(int l, const Envelope& env)
+{
+	if (sameEnvelope(env, stored[l]))
+		return;
+	stored[l] = env;
+	envelopes[l] = env;
+	renderEnvelope(l);
+}
+
+// renders the envelope of a lane from the current sample to the end of the block
+void Excitation::renderEnvelope(int l)
+{
+	envFrom[l] = pos;
+	envStart[l] = envelopes[l];
+	auto on = envelopes[l].renderBlock(envBlock[l] + pos, BLOCK - pos);
+	envOnUntil[l] = envelopes[l].state != 0 ? BLOCK + 1.0 : (double)(pos + on);
+}
+
+// envelope state of a lane at the current sample, without a segment change since the render started
+// it is the end state with the rendered value, otherwise it is rendered again from the start of the render
+Envelope Excitation::envelopeAt(int l)
+{
+	if (pos == BLOCK)
+		return envelopes[l];
+	if (pos == envFrom[l])
+		return envStart[l];
+	if (envStart[l].state == envelopes[l].state) {
+		auto env = envelopes[l];
+		env.env = envBlock[l][pos - 1];
+		return env;
+	}
+	auto env = envStart[l];
+	double skipped[BLOCK];
+	if (pos > envFrom[l])
+		env.renderBlock(skipped, pos - envFrom[l]);
+	return env;
+}
+
+// advances all lanes one sample
+void Excitation::process()
+{
+	alignas(32) double active[LANES];
+	alignas(32) double filtered[LANES];
+	for (int l = 0; l < LANES; ++l)
+		active[l] = countdown[l] > 0.0 ? 1.0 : 0.0;
+
+	malletFilters.processParallel(impulse, filtered, active);
+
+	for (int l = 0; l < LANES; ++l) {
+		bool on = active[l] != 0.0;
+		malletOut[l] = on ? filtered[l] * 2.0 : 0.0;
+		countdown[l] -= active[l];
+		impulse[l] *= on ? impulseDecay[l] : 1.0;
+	}
+
+	if (pos == BLOCK) {
+		generateNoise();
+		for (int l = 0; l < LANES; ++l)
+			renderEnvelope(l);
+	}
+
+	alignas(32) double noise[LANES];
+	alignas(32) double envOn[LANES];
+	for (int l = 0; l < LANES; ++l) {
+		envOn[l] = pos < envOnUntil[l] ? 1.0 : 0.0;
+		noise[l] = noiseBlock[pos][l] * envOn[l];
+		active[l] = envOn[l] * filterOn[l];
+	}
+
+	noiseFilters.processParallel(noise, filtered, active);
+
+	double anyEnded = 0.0;
+	for (int l = 0; l < LANES; ++l) {
+		noise[l] = active[l] != 0.0 ? filtered[l] : noise[l];
+		noiseEnv[l] = envBlock[l][pos];
+		noiseActive[l] = pos + 1 < envOnUntil[l] ? 1.0 : 0.0;
+		noiseOut[l] = noise[l] * noiseEnv[l];
+		anyEnded += envOn[l] - noiseActive[l];
+	}
+
+	// envelope has finished, clear filter to avoid pops
+	if (anyEnded > 0.0) {
+		for (int l = 0; l < LANES; ++l) {
+			if (envOn[l] != noiseActive[l])
+				noiseFilters.clearLane(l);
+		}
+	}
+
+	++pos;
+}
@@ -0,0 +1,64 @@
+// Copyright 2025 tilr
+// Excitation advances the impulse mallets and noise generators of all voices together
+// each voice state is loaded into one lane of plain arrays so every step is vectorized across voices,
+// voices are loaded at the start of a block and stored back before any event that changes them
+
+#pragma once
+#include <cstdint>
+#include "../Globals.h"
+#include "Envelope.h"
+#include "BiquadBank.h"
+
+class Voice;
+
+class Excitation
+{
+public:
+	Excitation();
+	~Excitation() {};
+
+	static constexpr int LANES = globals::MAX_POLYPHONY;
+
+	void load(Voice& voice, int lane);
+	void store(Voice& voice, int lane);
+	void deactivate(int lane);
+	void process();
+	bool isNoiseActive(int lane) const { return noiseActive[lane] != 0.0; }
+
+	alignas(32) double malletOut[LANES] = {}; // impulse mallet output of the last step
+	alignas(32) double noiseOut[LANES] = {}; // filtered noise times envelope of the last step
+	alignas(32) double noiseEnv[LANES] = {}; // noise envelope value of the last step
+	alignas(32) double noiseActive[LANES] = {}; // 1 while the noise envelope is on after the last step
+
+private:
+	// impulse mallet, bandpass filtered decaying impulse
+	alignas(32) double impulse[LANES] = {};
+	alignas(32) double impulseDecay[LANES] = {};
+	alignas(32) double countdown[LANES] = {};
+	BiquadBank<double, LANES> malletFilters{};
+
+	// noise generator and filter, the white noise of every lane is generated BLOCK samples ahead
+	static constexpr int BLOCK = 32;
+	int pos = BLOCK; // next sample read from the generated block
+	alignas(32) uint32_t blockSeeds[LANES] = {}; // generator state at the start of the block
+	alignas(32) uint32_t seeds[BLOCK][LANES] = {}; // generator state after each sample of the block
+	alignas(32) double noiseBlock[BLOCK][LANES] = {};
+	alignas(32) double filterOn[LANES] = {};
+	BiquadBank<double, LANES> noiseFilters{};
+
+	// noise envelope of every lane rendered up to the end of the block with Envelope::renderBlock,
+	// the state at the sample the render started is kept to find the state of any later sample
+	alignas(32) double envBlock[LANES][BLOCK] = {};
+	alignas(32) double envOnUntil[LANES] = {}; // the envelope is on before the samples of the block below this index
+	int envFrom[LANES] = {}; // sample of the block the render started
+	Envelope envStart[LANES]; // state at envFrom
+	Envelope envelopes[LANES]; // state at the end of the block
+	Envelope stored[LANES]; // state last stored into the voice, loading it again keeps the render
+
+	uint32_t& seed(int lane) { return pos == 0 ? blockSeeds[lane] : seeds[pos - 1][lane]; } // state before the next sample
+	void setSeed(int lane, uint32_t seed);
+	void generateNoise();
+	void setEnvelope(int lane, const Envelope& env);
+	void renderEnvelope(int lane);
+	Envelope envelopeAt(int lane);
+};
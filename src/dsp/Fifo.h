@@ -0,0 +1,46 @@
+// Copyright 2025 tilr
+// Single producer single consumer wait-free queue
+// used to pass messages between the message thread and the audio thread without locks
+#pragma once
+#include <array>
+#include "JuceHeader.h"
+
+template <typename T, int Capacity>
+class Fifo
+{
+public:
+	Fifo() {};
+	~Fifo() {};
+
+	// returns false if the queue is full
+	bool push(const T& item)
+	{
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0)
+			return false;
+
+		items[(size_t)(size1 > 0 ? start1 : start2)] = item;
+		fifo.finishedWrite(1);
+		return true;
+	}
+
+	// returns false if the queue is empty
+	bool pop(T& item)
+	{
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0)
+			return false;
+
+		item = items[(size_t)(size1 > 0 ? start1 : start2)];
+		fifo.finishedRead(1);
+		return true;
+	}
+
+	int getNumReady() const { return fifo.getNumReady(); }
+
+private:
+	juce::AbstractFifo fifo{ Capacity };
+	std::array<T, Capacity> items{};
+};
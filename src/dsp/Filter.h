@@ -1,28 +1,6 @@
 // Copyright 2025 tilr
-// Incomplete port of Theo Niessink <theo@taletn.com> rbj filters
+// Single RBJ filter, port of Theo Niessink <theo@taletn.com> rbj filters now provided by BiquadBank
 #pragma once
+#include "BiquadBank.h"
 
-class Filter
-{
-public:
-	Filter() {};
-	~Filter() {};
-
-	void lp(double srate, double freq, double q);
-	void bp(double srate, double freq, double q);
-	void hp(double srate, double freq, double q);
-	void clear(double input);
-	double df1(double sample);
-	void copy(Filter& f);
-
-private:
-	double a1 = 0.0;
-	double a2 = 0.0;
-	double b0 = 0.0;
-	double b1 = 0.0;
-	double b2 = 0.0;
-	double x0 = 0.0;
-	double x1 = 0.0;
-	double y0 = 0.0;
-	double y1 = 0.0;
-};
\ No newline at end of file
+using Filter = BiquadBank<double, 1>;
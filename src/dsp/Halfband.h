@@ -0,0 +1,102 @@
+// Copyright 2025 tilr
+// Halfband FIR used to decimate or interpolate by two, one sample at a time
+// kaiser windowed sinc where every other tap but the center is zero, so each polyphase branch is short
+// Halfband passes up to 0.2 of the faster rate and rejects 60dB from 0.3, used by the multirate partials
+// SteepHalfband passes up to 0.23 and rejects 90dB from 0.27, used by the engine rate resampler
+// both delay DELAY samples of the faster rate
+
+#pragma once
+#include <cmath>
+#include <array>
+#include <algorithm>
+#include <iterator>
+#include "JuceHeader.h"
+
+template <int NumPairs, int Beta>
+class HalfbandFIR
+{
+public:
+	static constexpr int PAIRS = NumPairs; // non zero taps on each side of the center
+	static constexpr int TAPS = 4 * PAIRS - 1;
+	static constexpr int DELAY = 2 * PAIRS - 1;
+
+	HalfbandFIR() { clear(); }
+	~HalfbandFIR() {};
+
+	void clear()
+	{
+		std::fill(std::begin(x), std::end(x), 0.0);
+		pos = 0;
+	}
+
+	// pushes a sample, the input of the decimator or the low rate input of the interpolator
+	void push(double input)
+	{
+		pos = pos == 0 ? TAPS - 1 : pos - 1;
+		x[pos] = input;
+		x[pos + TAPS] = input; // mirrored so the taps read one contiguous window
+	}
+
+	// decimator output, read after every second push
+	double decimate() const
+	{
+		auto& h = taps();
+		auto w = &x[pos]; // w[j] is the input j samples ago
+		auto sum = 0.5 * w[DELAY];
+		for (int p = 0; p < PAIRS; ++p)
+			sum += h[p] * (w[DELAY - 2 * p - 1] + w[DELAY + 2 * p + 1]);
+		return sum;
+	}
+
+	// interpolator outputs at twice the rate of the pushed samples, even is read after a push, odd the next sample
+	double even() const
+	{
+		auto& h = taps();
+		auto w = &x[pos];
+		auto sum = 0.0;
+		for (int p = 0; p < PAIRS; ++p)
+			sum += h[p] * (w[PAIRS - 1 - p] + w[PAIRS + p]);
+		return sum * 2.0;
+	}
+
+	double odd() const
+	{
+		return x[pos + PAIRS - 1]; // the center tap is 0.5, doubled by the zero stuffing
+	}
+
+private:
+	double x[TAPS * 2] = {};
+	int pos = 0;
+
+	// side taps at odd offsets from the center, normalized so the dc gain is one
+	static const std::array<double, PAIRS>& taps()
+	{
+		static const std::array<double, PAIRS> h = [] {
+			auto bessel0 = [](double v) {
+				double sum = 1.0, term = 1.0;
+				for (int k = 1; k < 30; ++k) {
+					term *= (v / (2.0 * k)) * (v / (2.0 * k));
+					sum += term;
+				}
+				return sum;
+			};
+			constexpr double beta = (double)Beta;
+			std::array<double, PAIRS> t{};
+			double sum = 0.0;
+			for (int p = 0; p < PAIRS; ++p) {
+				double n = 2.0 * p + 1.0;
+				double r = n / DELAY;
+				auto sinc = sin(juce::MathConstants<double>::halfPi * n) / (juce::MathConstants<double>::halfPi * n);
+				t[p] = 0.5 * sinc * bessel0(beta * sqrt(1.0 - r * r)) / bessel0(beta);
+				sum += 2.0 * t[p];
+			}
+			for (auto& v : t)
+				v *= 0.5 / sum;
+			return t;
+		}();
+		return h;
+	}
+};
+
+using Halfband = HalfbandFIR<10, 6>;
+using SteepHalfband = HalfbandFIR<32, 9>;
@@ -0,0 +1,51 @@
+#include "Kernels.h"
+#include <JuceHeader.h>
+#include <cstdint>
+#if RIPPLER_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#elif RIPPLER_X86
+#include <cpuid.h>
+#endif
+
+std::atomic<const Kernels*> Kernels::current { &kernels::generic::table };
+
+#if RIPPLER_X86
+// register state the os saves on context switches (XCR0), zero when the os does not support xgetbv
+// the cpuid flags alone do not tell if the YMM or ZMM registers can be used
+static uint64_t enabledState()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27))) // OSXSAVE
+		return 0;
+	return _xgetbv(0);
+#else
+	unsigned a, b, c, d;
+	if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & (1u << 27))) // OSXSAVE
+		return 0;
+	uint32_t lo, hi;
+	__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+#endif
+
+// picks the widest instruction set supported by the cpu, the result is the same for every instance
+const Kernels& Kernels::select()
+{
+	const Kernels* table = &kernels::generic::table;
+#if RIPPLER_X86
+	auto state = enabledState();
+	bool ymm = (state & 0x6) == 0x6; // SSE and AVX state
+	bool zmm = ymm && (state & 0xe0) == 0xe0; // opmask, upper ZMM0-15 and ZMM16-31 state
+	if (zmm && juce::SystemStats::hasAVX512F() && juce::SystemStats::hasAVX512DQ() && juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+		table = &kernels::avx512::table;
+	else if (ymm && juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+		table = &kernels::avx2::table;
+	else if (juce::SystemStats::hasSSE41())
+		table = &kernels::sse41::table;
+#endif
+	current.store(table, std::memory_order_relaxed);
+	return *table;
+}
@@ -0,0 +1,57 @@
+// Copyright 2025 tilr
+// Table of the vectorizable DSP loops, built once per instruction set in the Kernels*.cpp files
+// the best table for the running cpu is selected by select() from prepareToPlay
+
+#pragma once
+#include <atomic>
+#include "PartialBank.h"
+#include "WaveguideLanes.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RIPPLER_X86 1
+#else
+#define RIPPLER_X86 0
+#endif
+
+struct Kernels
+{
+	const char* name;
+
+	// sums the partials of a bank and advances them one sample, fixed size versions indexed by log2 of the partials count
+	// partialsN runs the lanes from first to last, the rate bands of multirate partials are consecutive lanes
+	double (*partials[7])(PartialBank& bank, double input);
+	double (*partialsN)(PartialBank& bank, double input, int first, int last);
+
+	// advances the waveguide lanes with on == 1 one sample, on is 1 or 0, out is zero for the others
+	void (*waveguides)(WaveguideLanes& lanes, const double* in, double* out, const double* on);
+
+	// advances a bank of coupled form oscillators n samples and writes the weighted sum of the sines of each sample
+	void (*sineBank)(double* sn, double* cs, const double* rotCos, const double* rotSin, const double* gain,
+		int size, double* out, int n);
+
+	// one sample for each of n TDF-II biquads, filters with active == 0 keep their state, active may be null
+	void (*biquadParallel)(const double* b0, const double* b1, const double* b2, const double* a1, const double* a2,
+		double* s1, double* s2, const double* in, double* out, const double* active, int n);
+
+	// squared stereo peak of each sample
+	void (*peakLevels)(const double* left, const double* right, double* level, int n);
+
+	// level = max(0, scale * log2(max(level, 1e-30)) - offset)
+	void (*overLevels)(double* level, double scale, double offset, int n);
+
+	static const Kernels& select();
+	static const Kernels& get() { return *current.load(std::memory_order_relaxed); }
+
+private:
+	static std::atomic<const Kernels*> current;
+};
+
+namespace kernels
+{
+	namespace generic { extern const Kernels table; }
+#if RIPPLER_X86
+	namespace sse41 { extern const Kernels table; }
+	namespace avx2 { extern const Kernels table; }
+	namespace avx512 { extern const Kernels table; }
+#endif
+}
@@ -0,0 +1,8 @@
+// Kernels built with AVX2 and FMA, the compile flags are set for this file in CMakeLists.txt
+
+#include "Kernels.h"
+#if RIPPLER_X86
+#define KERNELS_NAME "AVX2"
+#define KERNELS_NAMESPACE avx2
+#include "KernelsImpl.h"
+#endif
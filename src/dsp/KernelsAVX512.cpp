@@ -0,0 +1,8 @@
+// Kernels built with AVX-512, the compile flags are set for this file in CMakeLists.txt
+
+#include "Kernels.h"
+#if RIPPLER_X86
+#define KERNELS_NAME "AVX-512"
+#define KERNELS_NAMESPACE avx512
+#include "KernelsImpl.h"
+#endif
@@ -0,0 +1,11 @@
+// Kernels built with the baseline instruction set of the target, SSE2 on x86-64 and NEON on arm64
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define KERNELS_NAME "NEON"
+#elif defined(__x86_64__) || defined(_M_X64)
+#define KERNELS_NAME "SSE2"
+#else
+#define KERNELS_NAME "Generic"
+#endif
+#define KERNELS_NAMESPACE generic
+#include "KernelsImpl.h"
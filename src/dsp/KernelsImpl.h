@@ -0,0 +1,196 @@
+// Copyright 2025 tilr
+// Kernel bodies included by each Kernels*.cpp inside its own namespace,
+// only plain loops and operators are used here so no inline function from a shared header
+// is compiled with the instruction set of one variant and picked by the linker for another
+
+#ifndef KERNELS_NAMESPACE
+#error "define KERNELS_NAMESPACE and KERNELS_NAME before including KernelsImpl.h"
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include "Kernels.h"
+
+namespace kernels
+{
+namespace KERNELS_NAMESPACE
+{
+	// one sample of partial i, lanes that are off keep their state and output silence
+	static inline double partial(PartialBank& bank, int i, double input)
+	{
+		auto y = bank.b0[i] * input + bank.s1[i];
+		auto ns1 = bank.s2[i] - bank.a1[i] * y;
+		auto ns2 = bank.b2[i] * input - bank.a2[i] * y;
+		bool on = bank.on[i] != 0.0;
+		bank.s1[i] = on ? ns1 : bank.s1[i];
+		bank.s2[i] = on ? ns2 : bank.s2[i];
+		return y * bank.on[i];
+	}
+
+	template <int N>
+	static double partials(PartialBank& bank, double input)
+	{
+		constexpr int L = N < 4 ? N : 4; // one sum per lane so the loop needs no horizontal adds
+		double out[L] = {};
+		for (int i = 0; i < N; i += L) {
+			for (int j = 0; j < L; ++j)
+				out[j] += partial(bank, i + j, input);
+		}
+		double sum = 0.0;
+		for (int j = 0; j < L; ++j)
+			sum += out[j];
+		return sum;
+	}
+
+	static double partialsN(PartialBank& bank, double input, int first, int last)
+	{
+		double sum = 0.0;
+		for (int i = first; i < last; ++i)
+			sum += partial(bank, i, input);
+		return sum;
+	}
+
+	static void sineBank(double* sn, double* cs, const double* rotCos, const double* rotSin, const double* gain,
+		int size, double* out, int n)
+	{
+		constexpr int B = 32; // samples accumulated per pass over the oscillators
+		for (int start = 0; start < n; start += B) {
+			int count = n - start < B ? n - start : B;
+			double acc[B][4] = {}; // one sum per lane so the loop needs no horizontal adds
+			for (int i = 0; i < size; i += 4) {
+				// four oscillators stay in registers for the whole pass
+				double s[4], c[4], rc[4], rs[4], g[4];
+				for (int j = 0; j < 4; ++j) {
+					s[j] = sn[i + j];
+					c[j] = cs[i + j];
+					rc[j] = rotCos[i + j];
+					rs[j] = rotSin[i + j];
+					g[j] = gain[i + j];
+				}
+				for (int k = 0; k < count; ++k) {
+					for (int j = 0; j < 4; ++j) {
+						acc[k][j] += s[j] * g[j];
+						auto ns = s[j] * rc[j] + c[j] * rs[j];
+						auto nc = c[j] * rc[j] - s[j] * rs[j];
+						s[j] = ns;
+						c[j] = nc;
+					}
+				}
+				for (int j = 0; j < 4; ++j) {
+					sn[i + j] = s[j];
+					cs[i + j] = c[j];
+				}
+			}
+			for (int k = 0; k < count; ++k)
+				out[start + k] = acc[k][0] + acc[k][1] + acc[k][2] + acc[k][3];
+		}
+	}
+
+	static void biquadParallel(const double* b0, const double* b1, const double* b2, const double* a1, const double* a2,
+		double* s1, double* s2, const double* in, double* out, const double* active, int n)
+	{
+		if (!active) {
+			for (int i = 0; i < n; ++i) {
+				auto x = in[i];
+				auto y = b0[i] * x + s1[i];
+				s1[i] = b1[i] * x - a1[i] * y + s2[i];
+				s2[i] = b2[i] * x - a2[i] * y;
+				out[i] = y;
+			}
+			return;
+		}
+		for (int i = 0; i < n; ++i) {
+			auto x = in[i];
+			auto y = b0[i] * x + s1[i];
+			auto ns1 = b1[i] * x - a1[i] * y + s2[i];
+			auto ns2 = b2[i] * x - a2[i] * y;
+			bool on = active[i] != 0.0;
+			s1[i] = on ? ns1 : s1[i];
+			s2[i] = on ? ns2 : s2[i];
+			out[i] = y;
+		}
+	}
+
+	// gathers the two read taps of every lane, runs the interpolation, radius lowpass and decay across lanes
+	// and scatters the tube input, on is 1 or 0 and is used as a blend weight so the middle loop has no branches,
+	// lanes that are off keep their state and skip the scatter
+	static void waveguides(WaveguideLanes& lanes, const double* in, double* out, const double* on)
+	{
+		constexpr int L = WaveguideLanes::LANES;
+		alignas(64) double tap0[L];
+		alignas(64) double tap1[L];
+		alignas(64) double input[L];
+
+		for (int l = 0; l < L; ++l) {
+			int i0 = (int)lanes.readPos[l];
+			int i1 = (i0 + 1) & (lanes.length[l] - 1);
+			tap0[l] = lanes.tube[l][i0];
+			tap1[l] = lanes.tube[l][i1];
+		}
+
+		for (int l = 0; l < L; ++l) {
+			auto read = lanes.readPos[l];
+			auto frac = read - (double)(int)read;
+			auto sample = tap0[l] * (1.0 - frac) + tap1[l] * frac;
+			auto y = lanes.radius[l] * sample + (1.0 - lanes.radius[l]) * lanes.y1[l];
+			auto dsample = y * lanes.gain[l];
+			lanes.y1[l] = y * on[l] + lanes.y1[l] * (1.0 - on[l]);
+			out[l] = dsample * on[l];
+			input[l] = in[l] + dsample;
+			read += on[l];
+			auto len = lanes.length[l];
+			lanes.readPos[l] = read - (double)(len * ((int)read >= len)); // integer select, a double compare would keep a branch
+		}
+
+		for (int l = 0; l < L; ++l) {
+			if (on[l] == 0.0)
+				continue;
+			auto write = lanes.writePos[l];
+			lanes.tube[l][write] = input[l];
+			write = (write + 1) & (lanes.length[l] - 1);
+			lanes.wrapped[l] |= write == 0;
+			lanes.writePos[l] = write;
+		}
+	}
+
+	static void peakLevels(const double* left, const double* right, double* level, int n)
+	{
+		for (int i = 0; i < n; ++i) {
+			auto l = left[i] < 0.0 ? -left[i] : left[i];
+			auto r = right[i] < 0.0 ? -right[i] : right[i];
+			auto maxspl = l > r ? l : r;
+			level[i] = maxspl * maxspl;
+		}
+	}
+
+	// log2 from the exponent bits and a series on the mantissa, error below 1e-6
+	static void overLevels(double* level, double scale, double offset, int n)
+	{
+		for (int i = 0; i < n; ++i) {
+			auto x = level[i] > 1e-30 ? level[i] : 1e-30;
+			uint64_t bits;
+			std::memcpy(&bits, &x, sizeof(bits));
+			auto e = (double)((int64_t)(bits >> 52) - 1023);
+			bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+			double m;
+			std::memcpy(&m, &bits, sizeof(m)); // mantissa in [1, 2)
+			auto t = (m - 1.0) / (m + 1.0);
+			auto t2 = t * t;
+			auto ln = 2.0 * t * (1.0 + t2 * (1.0 / 3.0 + t2 * (1.0 / 5.0 + t2 * (1.0 / 7.0 + t2 * (1.0 / 9.0)))));
+			auto over = scale * (e + ln * 1.4426950408889634) - offset; // 1 / ln(2)
+			level[i] = over > 0.0 ? over : 0.0;
+		}
+	}
+
+	extern const Kernels table = {
+		KERNELS_NAME,
+		{ partials<1>, partials<2>, partials<4>, partials<8>, partials<16>, partials<32>, partials<64> },
+		partialsN,
+		waveguides,
+		sineBank,
+		biquadParallel,
+		peakLevels,
+		overLevels,
+	};
+}
+}
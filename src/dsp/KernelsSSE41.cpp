@@ -0,0 +1,8 @@
+// Kernels built with SSE4.1, the compile flags are set for this file in CMakeLists.txt
+
+#include "Kernels.h"
+#if RIPPLER_X86
+#define KERNELS_NAME "SSE4.1"
+#define KERNELS_NAMESPACE sse41
+#include "KernelsImpl.h"
+#endif
@@ -27,14 +27,25 @@
 
 #pragma once
 #include <cmath>
-#include <tuple>
+#include <vector>
+#include <algorithm>
+#include "Kernels.h"
 
+// Block version, runs on chunks of BLOCK samples
+// peak detection, the polynomial log2 of the level and the gain curve table are branch-free block loops,
+// the rms, attack and release smoothing are recursive and stay per sample
+// an optional look-ahead delays the audio so the gain reduction is in place before the peaks arrive
 class Limiter
 {
 public:
 	Limiter() {};
 	~Limiter() {};
 
+	static constexpr int BLOCK = 64;
+	static constexpr double LOOKAHEAD_MS = 1.5;
+	static constexpr int CURVE_SIZE = 4096;
+	static constexpr double CURVE_MAX_DB = 96.0; // overdb range of the gain curve table
+
 	void init(double srate, double _thresh = 0.0, double _bias = 70.0, double rms_win = 100.0, double makeup = 0.0)
 	{
 		threshv = exp(_thresh * db2log);
@@ -51,34 +62,41 @@ public:
 		rmscoef = exp(-1.0 / (rmstime * srate));
 		rmstime = rms_win / 1000000.0;
 		runave = 0.0;
+		rundb = 0.0;
+
+		// gain for each overdb, grv = exp(-overdb * (cratio - 1) / cratio * db2log)
+		curve.resize(CURVE_SIZE + 1);
+		for (int i = 0; i <= CURVE_SIZE; ++i) {
+			auto overdb = CURVE_MAX_DB * i / CURVE_SIZE;
+			auto cratio = bias == 0.0 ? ratio : 1.0 + (ratio - 1.0) * sqrt(overdb / bias);
+			curve[i] = exp(-overdb * (cratio - 1.0) / cratio * db2log) * makeupv;
+		}
+
+		lookaheadSamples = (int)(LOOKAHEAD_MS * 0.001 * srate);
+		int size = 1;
+		while (size <= lookaheadSamples) size <<= 1;
+		delayL.assign(size, 0.0);
+		delayR.assign(size, 0.0);
+		mask = size - 1;
+		pos = 0;
+	}
+
+	void setLookahead(bool on)
+	{
+		if (on == lookahead) return;
+		lookahead = on;
+		std::fill(delayL.begin(), delayL.end(), 0.0);
+		std::fill(delayR.begin(), delayR.end(), 0.0);
 	}
 
-	std::tuple<double, double> process(double spl0, double spl1)
+	// latency added by the look-ahead, to be reported to the host
+	int getLatency() const { return lookahead ? lookaheadSamples : 0; }
+
+	// limits a stereo block in place
+	void process(double* left, double* right, int n)
 	{
-		auto maxspl = fmax(fabs(spl0), fabs(spl1));
-		maxspl = maxspl * maxspl;
-
-		runave = maxspl + rmscoef * (runave - maxspl);
-		auto det = sqrt(fmax(0.0, runave));
-		auto overdb = fmax(0.0, capsc * log(det/threshv));
-
-		if (overdb > rundb)
-			rundb = overdb + atcoef * (rundb - overdb);
-		else
-			rundb = overdb + relcoef * (rundb - overdb);
-		overdb = fmax(0.0, rundb);
-
-		auto cratio = bias == 0.0
-			? ratio
-			: 1.0 + (ratio -1.0) * sqrt(overdb / bias);
-
-		auto gr = -overdb * (cratio - 1.0) / cratio;
-		auto grv = exp(gr * db2log);
-
-		return std::tuple<double, double> (
-			spl0 * grv * makeupv,
-			spl1 * grv * makeupv
-		);
+		for (int i = 0; i < n; i += BLOCK)
+			processChunk(left + i, right + i, std::min(BLOCK, n - i));
 	}
 
 private:
@@ -101,4 +119,61 @@ private:
   double relcoef = 0.0;
   double rmstime = 0.0;
   double rmscoef = 0.0;
+
+  std::vector<double> curve;
+  bool lookahead = false;
+  int lookaheadSamples = 0;
+  std::vector<double> delayL;
+  std::vector<double> delayR;
+  int mask = 0;
+  int pos = 0;
+
+  void processChunk(double* left, double* right, int n)
+  {
+	  alignas(32) double level[BLOCK];
+	  alignas(32) double gain[BLOCK];
+
+	  auto& kernels = Kernels::get();
+
+	  // peak detection
+	  kernels.peakLevels(left, right, level, n);
+
+	  // rms smoothing
+	  for (int i = 0; i < n; ++i) {
+		  runave = level[i] + rmscoef * (runave - level[i]);
+		  level[i] = runave;
+	  }
+
+	  // overdb = capsc * log(sqrt(runave) / threshv), with a fast log2
+	  auto overScale = capsc * 0.5 * 0.6931471805599453; // capsc * ln(x) / 2 from log2
+	  auto overOffset = capsc * log(threshv);
+	  kernels.overLevels(level, overScale, overOffset, n);
+
+	  // attack and release
+	  for (int i = 0; i < n; ++i) {
+		  auto coef = level[i] > rundb ? atcoef : relcoef;
+		  rundb = level[i] + coef * (rundb - level[i]);
+		  level[i] = std::max(0.0, rundb);
+	  }
+
+	  // gain curve
+	  constexpr double toIndex = CURVE_SIZE / CURVE_MAX_DB;
+	  for (int i = 0; i < n; ++i) {
+		  auto x = std::min(level[i] * toIndex, (double)CURVE_SIZE - 1.0);
+		  auto idx = (int)x;
+		  auto frac = x - idx;
+		  gain[i] = curve[idx] + (curve[idx + 1] - curve[idx]) * frac;
+	  }
+
+	  // apply to the delayed signal, without look-ahead the delay reads the sample just written
+	  auto delay = lookahead ? lookaheadSamples : 0;
+	  for (int i = 0; i < n; ++i) {
+		  delayL[pos] = left[i];
+		  delayR[pos] = right[i];
+		  auto rpos = (pos - delay) & mask;
+		  left[i] = delayL[rpos] * gain[i];
+		  right[i] = delayR[rpos] * gain[i];
+		  pos = (pos + 1) & mask;
+	  }
+  }
 };
\ No newline at end of file
@@ -15,6 +15,7 @@ void Mallet::trigger(MalletType _type, double _srate, double freq, int note, dou
 		env = exp(-100.0 / srate);
 	}
 	else {
+		playing = &sampler;
 		keytrack_factor = std::pow(2.0, ((note - 60) / 12.0) * ktrack);
 		playback_speed = sampler.wavesrate / srate;
 		playback = 0.0;
@@ -26,8 +27,8 @@ void Mallet::clear()
 	countdown = 0;
 	impulse = 0.0;
 	playback = INFINITY;
-	impulse_filter.clear(0.0);
-	sample_filter.clear(0.0);
+	impulse_filter.clear();
+	sample_filter.clear();
 }
 
 double Mallet::process()
@@ -35,22 +36,29 @@ double Mallet::process()
 	auto sample = 0.0;
 
 	if (type == kImpulse && countdown > 0) {
-		sample = impulse_filter.df1(impulse) * 2.0;
+		sample = impulse_filter.process(impulse) * 2.0;
 		countdown -= 1;
 		impulse *= env;
 	}
-	else if (type >= kUserFile && playback < sampler.waveform.size()) {
-		sample = sampler.waveCubic(playback);
-		playback += playback_speed * sampler.pitchfactor * keytrack_factor;
+	else if (type >= kUserFile && playing && playback < playing->waveform.size()) {
+		sample = playing->waveCubic(playback);
+		playback += playback_speed * playing->pitchfactor * keytrack_factor;
 
 		if (!disable_filter) {
-			sample = sample_filter.df1(sample);
+			sample = sample_filter.process(sample);
 		}
 	}
 
 	return sample;
 }
 
+bool Mallet::isActive() const
+{
+	if (type == kImpulse)
+		return countdown > 0;
+	return type >= kUserFile && playing && playback < playing->waveform.size();
+}
+
 void Mallet::setFilter(double norm)
 {
 	double freq = 20.0 * std::pow(20000.0/20.0, norm < 0.0 ? 1 + norm : norm); // map 1..0 to 20..20000, with inverse scale for negative norm
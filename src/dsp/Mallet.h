@@ -48,6 +48,10 @@ public:
 	void trigger(MalletType type, double srate, double freq, int note, double ktrack);
 	void clear();
 	double process();
+	bool isActive() const;
+	bool isImpulse() const { return type == kImpulse; }
+	bool isPlaying(const Sampler& s) const { return isActive() && playing == &s; }
+	void holdSample(const Sampler& s) { playing = &s; }
 
 	void setFilter(double norm);
 
@@ -69,5 +73,6 @@ public:
 
 private:
 	Sampler& sampler;
+	const Sampler* playing = nullptr; // sample of the last hit, held when the shared sample changes under a ringing voice
 	MalletType type = kImpulse;
 };
\ No newline at end of file
@@ -1,5 +1,4 @@
 #include "Noise.h"
-#include <cstdlib>
 #include <cmath>
 
 void Noise::init(
@@ -53,7 +52,7 @@ void Noise::initFilter()
 	else if (fmode == 2) filter.hp(srate, f, res);
 	else throw "Unknown filter mode";
 
-	osc_filter.copy(filter);
+	osc_filter.copyCoefs(filter);
 }
 
 static double susToDb(double val) {
@@ -82,28 +81,28 @@ void Noise::release()
 void Noise::clear()
 {
 	env.reset();
-	filter.clear(0.0);
-	osc_filter.clear(0.0);
+	filter.clear();
+	osc_filter.clear();
 }
 
-double Noise::process()
+bool Noise::isActive() const
 {
-	if (!env.state) return 0.0;
-	env.process();
-	double sample = (std::rand() / (double)RAND_MAX) * 2.0 - 1.0;
-	if (filter_active)
-		sample = filter.df1(sample);
-
-	if (!env.state)
-		filter.clear(0.0); // envelope has finished, clear filter to avoid pops
+	return env.state != 0;
+}
 
-	return sample * env.env;
+// seeds the generator with splitmix32 of the seed, same seed gives the same noise
+void Noise::seed(uint32_t seed)
+{
+	uint32_t z = seed + 0x9e3779b9;
+	z = (z ^ (z >> 16)) * 0x85ebca6b;
+	z = (z ^ (z >> 13)) * 0xc2b2ae35;
+	z ^= z >> 16;
+	rng = z ? z : 1; // xorshift state can't be zero
 }
 
 // runs the input through the same filter and envelope as this noise instance
-double Noise::processOSC(double input)
+double Noise::processOSC(double input, double _envValue)
 {
-	if (!env.state) return 0.0;
-	return (filter_active ? osc_filter.df1(input) : input) * env.env;
+	return (filter_active ? osc_filter.process(input) : input) * _envValue;
 }
 
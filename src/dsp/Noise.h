@@ -1,6 +1,8 @@
 // Copyright (C) 2025 tilr
 // Noise generator with a filter and envelope
+// holds the voice noise state and params, the noise of all voices is generated together by Excitation
 #pragma once
+#include <cstdint>
 #include "Filter.h"
 #include "Envelope.h"
 
@@ -14,13 +16,14 @@ public:
 		double sus, double rel, double vel_freq, double vel_q, double att_ten, double dec_ten, double rel_ten,
 		double vel_att, double vel_dec, double vel_sus, double vel_rel
 	);
-	double process();
 	void attack(double vel);
 	void initFilter();
 	void initEnvelope();
 	void release();
 	void clear();
-	double processOSC(double input);
+	double processOSC(double input, double envValue);
+	void seed(uint32_t seed);
+	bool isActive() const;
 
 	double att = 0.0;
 	double dec = 0.0;
@@ -42,9 +45,10 @@ public:
 	bool filter_active = false;
 
 	Envelope env{};
+	Filter filter{};
+	uint32_t rng = 1; // xorshift32 state, the noise is generated in the excitation lanes
 
 private:
-	Filter filter{};
 	Filter osc_filter{}; // filter duplicate used on oscillator exciters signal
 	int fmode = 0;
 	double freq = 0.0;
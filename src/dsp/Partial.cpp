@@ -7,114 +7,100 @@
 /**
  * a1 coefficient lookup table
  * used for re-tuning of the partial during pitch bends
+ * indexed by the frequency in cycles per sample so instances at any engine or partial rate share it
  */
 LookupTable Partial::a1LUT;
-LookupTable Partial::sinLUT;
 
-void Partial::initA1LUT(double sampleRate)
+void Partial::initA1LUT()
 {
-    static double a1LUTSrate = 0.0;
-    if (a1LUTSrate != sampleRate) {
-        constexpr double fMin = 1.0;
-        constexpr double fMax = 20000.0;
-        constexpr size_t LUT_SIZE = 4096;
+    static bool a1LUTReady = false;
+    if (!a1LUTReady) {
+        constexpr size_t LUT_SIZE = 8192;
 
         a1LUT.init(
-            [sampleRate](double f) {
-                double omega = juce::MathConstants<double>::twoPi * f / sampleRate;
-                return -2.0 * std::cos(omega);
+            [](double f) {
+                return -2.0 * std::cos(juce::MathConstants<double>::twoPi * f);
             },
-            fMin, fMax, LUT_SIZE
+            0.0, 0.5, LUT_SIZE
         );
 
-		sinLUT.init(
-			[sampleRate](double norm) {
-				return std::sin(juce::MathConstants<double>::twoPi * norm);
-			},
-			0.0, 1.0, LUT_SIZE
-		);
-
-        a1LUTSrate = sampleRate;
+        a1LUTReady = true;
     }
 }
 
-void Partial::update(double f_0, double ratio, double ratio_max, double vel, double pitch_bend, bool isRelease)
+// frequency stretch of a partial by the inharmonicity
+double Partial::stretch(const PartialParams& p, double ratio, double vel)
+{
+	auto inharm_k = fmax(0.0, fmin(1.0, exp(log(p.inharm) + vel * p.vel_inharm * -log(0.0001)) - 0.0001)); // normalize velocity contribution on a logarithmic scale
+	return sqrt(1 + inharm_k * (ratio - 1) * (ratio - 1));
+}
+
+void Partial::update(const PartialParams& p, PartialBank& bank, double f_0, double ratio, double ratio_max, double vel, double pitch_bend, bool isRelease)
 {
 	out_of_range = false;
-	auto inharm_k = fmax(0.0, fmin(1.0, exp(log(inharm) + vel * vel_inharm * -log(0.0001)) - 0.0001)); // normalize velocity contribution on a logarithmic scale
-	inharm_k = sqrt(1 + inharm_k * (ratio - 1) * (ratio - 1));
+	auto inharm_k = stretch(p, ratio, vel);
 	f_k = f_0 * ratio * inharm_k;
 	base_f_k = f_k;
 	f_k *= pitch_bend;
 
-	auto decay_k = fmax(0.01, fmin(100.0, exp(log(decay) + vel * vel_decay * (log(100.0) - log(0.01))))); // normalize velocity contribution on a logarithmic scale
+	auto decay_k = fmax(0.01, fmin(100.0, exp(log(p.decay) + vel * p.vel_decay * (log(100.0) - log(0.01))))); // normalize velocity contribution on a logarithmic scale
 	if (isRelease)
-		decay_k *= rel;
+		decay_k *= p.rel;
 
 	if (f_k >= 20000.0 || f_k < 1.0 || decay_k == 0.0) {
-		//b0 = b2 = a1 = a2 = 0.0;
-		//a0 = 1.0;
-		//return;
 		out_of_range = true;
 	}
 
 	auto f_max = fmin(20000.0, f_0 * ratio_max * inharm_k);
+	auto srate = p.srate / rate;
+	cycles = 1.0 / srate;
 	auto omega = juce::MathConstants<double>::twoPi * f_k / srate;
 	auto alpha = juce::MathConstants<double>::twoPi / srate; // aprox 1 sec decay
 
-	auto damp_base = std::fmin(1.0, std::fmax(-1.0, damp + vel_damp * 2.0 * vel));
+	auto damp_base = std::fmin(1.0, std::fmax(-1.0, p.damp + p.vel_damp * 2.0 * vel));
 	auto damp_k = damp_base <= 0
 		? pow(f_0 / f_k, damp_base * 2.0)
 		: pow(f_max / f_k, damp_base * 2.0);
 
 	decay_k /= damp_k;
 
-	auto tone_base = std::fmin(1.0, std::fmax(-1.0, tone + vel_tone * 2.0 * vel));
+	auto tone_base = std::fmin(1.0, std::fmax(-1.0, p.tone + p.vel_tone * 2.0 * vel));
 	auto tone_gain = tone_base <= 0
 		? pow(f_k / f_0, tone_base * 12 / 6)
 		: pow(f_k / f_max, tone_base * 12 / 6);
 
-	auto amp_k = fabs(sin(juce::MathConstants<double>::pi * k * fmax(0.02, fmin(.5, hit + vel_hit * vel / 2.0))));
+	auto amp_k = fabs(sin(juce::MathConstants<double>::pi * k * fmax(0.02, fmin(.5, p.hit + p.vel_hit * vel / 2.0))));
 	amp_k *= 35.0;
 
-	// Bandpass filter coefficients (normalized)
-	b0 = alpha * tone_gain * amp_k;
-	b2 = -alpha * tone_gain * amp_k;
+	// Bandpass filter coefficients normalized by a0
+	auto i = lane;
 	a0 = decay_k ? 1.0 + alpha / decay_k : 0.0;
-	a1 = -2.0 * cos(omega);
-	a2 = decay_k ? 1.0 - alpha / decay_k : 0.0;
-}
-
-double Partial::process(double input)
-{
-	if (out_of_range) return 0.0;
-	auto output = ((b0 * input + b2 * x2) - (a1 * y1 + a2 * y2)) / a0;
-	x2 = x1;
-	x1 = input;
-	y2 = y1;
-	y1 = output;
-
-	return output;
+	if (a0 == 0.0) {
+		out_of_range = true;
+		a0 = 1.0;
+	}
+	bank.b0[i] = alpha * tone_gain * amp_k / a0;
+	bank.b2[i] = -alpha * tone_gain * amp_k / a0;
+	bank.a1[i] = -2.0 * cos(omega) / a0;
+	bank.a2[i] = decay_k ? (1.0 - alpha / decay_k) / a0 : 0.0;
+	bank.on[i] = out_of_range ? 0.0 : 1.0;
 }
 
-void Partial::applyGain(double gain)
+void Partial::applyGain(PartialBank& bank, double gain)
 {
-	b0 *= gain;
-	b2 *= gain;
+	bank.b0[lane] *= gain;
+	bank.b2[lane] *= gain;
 }
 
-void Partial::applyPitchBend(double pitch_bend)
+void Partial::applyPitchBend(PartialBank& bank, double pitch_bend)
 {
 	out_of_range = false;
 	f_k = base_f_k * pitch_bend;
 	if (f_k < 1.0 || f_k > 20000.0) {
 		out_of_range = true;
+		bank.on[lane] = 0.0;
 		return;
 	}
-	a1 = a1LUT(f_k);
+	bank.a1[lane] = a1LUT(f_k * cycles) / a0;
+	bank.on[lane] = 1.0;
 }
-
-void Partial::clear()
-{
-	x1 = x2 = y1 = y2 = 0;
-}
\ No newline at end of file
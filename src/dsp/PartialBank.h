@@ -0,0 +1,18 @@
+// Copyright 2025 tilr
+// Hot state of the partials of a resonator, one lane per partial so the loop over partials vectorizes
+// each lane is a bandpass in transposed direct form II normalized by a0 (b1 is always zero),
+// lanes with on == 0 output silence and keep their state, like a partial out of the audible range
+
+#pragma once
+#include "../Globals.h"
+
+struct PartialBank
+{
+	alignas(64) double b0[globals::MAX_PARTIALS] = {};
+	alignas(64) double b2[globals::MAX_PARTIALS] = {};
+	alignas(64) double a1[globals::MAX_PARTIALS] = {};
+	alignas(64) double a2[globals::MAX_PARTIALS] = {};
+	alignas(64) double s1[globals::MAX_PARTIALS] = {};
+	alignas(64) double s2[globals::MAX_PARTIALS] = {};
+	alignas(64) double on[globals::MAX_PARTIALS] = {};
+};
@@ -0,0 +1,132 @@
+// Copyright 2025 tilr
+// Resampler between the host rate and the fixed engine rate, the host rate is the engine rate times a power of two factor
+// cascade of halfband stages, stage 0 runs next to the engine rate and is steep so the passband reaches 20kHz at 44.1kHz
+// one engine sample lines up with every factor host samples, on the host samples where the block phase wraps to zero
+// an instance runs in one direction only, decimate() for the input or interpolate() for one output channel
+
+#pragma once
+#include <algorithm>
+#include "Halfband.h"
+
+class Resampler
+{
+public:
+	static constexpr int MAX_STAGES = 3;
+	static constexpr int MAX_FACTOR = 1 << MAX_STAGES;
+	static constexpr double ENGINE_RATE_MIN = 44100.0;
+
+	Resampler() {};
+	~Resampler() {};
+
+	// largest power of two that keeps the host rate divided by it at or above 44.1kHz
+	static int factorFor(double hostRate)
+	{
+		int factor = 1;
+		while (factor < MAX_FACTOR && hostRate / (factor * 2) >= ENGINE_RATE_MIN - 1.0)
+			factor *= 2;
+		return factor;
+	}
+
+	// engine samples that line up with the next n host samples starting at phase
+	static int engineSamples(int n, int phase, int factor)
+	{
+		auto first = (factor - phase) & (factor - 1);
+		return n > first ? (n - 1 - first) / factor + 1 : 0;
+	}
+
+	void setFactor(int _factor)
+	{
+		factor = _factor;
+		stages = 0;
+		while ((1 << stages) < factor) ++stages;
+		clear();
+	}
+
+	int getFactor() const { return factor; }
+
+	// delay of interpolate() in host samples
+	int getLatency() const
+	{
+		int latency = 0;
+		for (int s = 0; s < stages; ++s)
+			latency += (s == 0 ? SteepHalfband::DELAY : Halfband::DELAY) << (stages - 1 - s);
+		return latency;
+	}
+
+	// zero engine samples it takes to flush interpolate()
+	int getTail() const
+	{
+		return stages ? SteepHalfband::TAPS + Halfband::TAPS : 0;
+	}
+
+	void clear()
+	{
+		steep.clear();
+		for (auto& stage : light)
+			stage.clear();
+	}
+
+	// host samples in, engine samples out, returns the number of engine samples written
+	// out may be the same array as in
+	int decimate(const double* in, double* out, int n, int phase)
+	{
+		if (factor == 1) {
+			std::copy(in, in + n, out);
+			return n;
+		}
+		int m = 0;
+		for (int i = 0; i < n; ++i) {
+			auto pos = (phase + i) & (factor - 1);
+			auto x = in[i];
+			int s = stages - 1;
+			for (; s >= 0; --s) { // from the fastest stage, stage s outputs every 2^(stages - s) host samples
+				push(s, x);
+				if (pos & ((2 << (stages - 1 - s)) - 1))
+					break;
+				x = s == 0 ? steep.decimate() : light[s - 1].decimate();
+			}
+			if (s < 0)
+				out[m++] = x;
+		}
+		return m;
+	}
+
+	// engine samples in, host samples out, reads one engine sample on each host sample where the phase wraps
+	void interpolate(const double* in, double* out, int n, int phase)
+	{
+		if (factor == 1) {
+			std::copy(in, in + n, out);
+			return;
+		}
+		int m = 0;
+		for (int i = 0; i < n; ++i) {
+			auto pos = (phase + i) & (factor - 1);
+			auto x = pos == 0 ? in[m++] : 0.0;
+			for (int s = 0; s < stages; ++s) { // from the slowest stage, stage s outputs every 2^(stages - 1 - s) host samples
+				auto period = 1 << (stages - 1 - s);
+				if (pos & (period - 1))
+					continue; // idle, so are the slower stages before it
+				if (pos & period) {
+					x = s == 0 ? steep.odd() : light[s - 1].odd();
+				}
+				else {
+					push(s, x);
+					x = s == 0 ? steep.even() : light[s - 1].even();
+				}
+			}
+			out[i] = x;
+		}
+	}
+
+private:
+	int factor = 1;
+	int stages = 0;
+	SteepHalfband steep{};
+	Halfband light[MAX_STAGES - 1]{};
+
+	void push(int s, double x)
+	{
+		if (s == 0) steep.push(x);
+		else light[s - 1].push(x);
+	}
+};
@@ -1,11 +1,15 @@
 #include "Resonator.h"
 #include <cmath>
+#include <algorithm>
+#include <iterator>
 #include <JuceHeader.h>
+#include "Kernels.h"
 
 Resonator::Resonator()
 {
 	for (int i = 0; i < globals::MAX_PARTIALS; ++i) {
-		partials.push_back(Partial(i + 1));
+		partials[i].k = i + 1;
+		partials[i].lane = i;
 	}
 }
 
@@ -21,28 +25,20 @@ void Resonator::setParams(double _srate, bool _on, int model, int _partials, dou
 	srate = _srate;
 	cut = _cut;
 
-	auto freq = 20.0 * std::pow(20000.0 / 20.0, cut < 0.0 ? 1 + cut : cut); // map 1..0 to 20..20000, with inverse scale for negative norm;
-	if (_cut < 0.0) {
-		filter.lp(srate, freq, 0.707);
-	}
-	else {
-		filter.hp(srate, freq, 0.707);
-	}
+	setCutFilter(filter, srate, cut);
 
-	for (Partial& partial : partials) {
-		partial.damp = damp;
-		partial.decay = decay;
-		partial.hit = hit;
-		partial.inharm = inharm;
-		partial.rel = _rel;
-		partial.tone = tone;
-		partial.vel_decay = vel_decay;
-		partial.vel_hit = vel_hit;
-		partial.vel_inharm = vel_inharm;
-		partial.vel_damp = vel_damp;
-		partial.vel_tone = vel_tone;
-		partial.srate = _srate;
-	}
+	partialParams.damp = damp;
+	partialParams.decay = decay;
+	partialParams.hit = hit;
+	partialParams.inharm = inharm;
+	partialParams.rel = _rel;
+	partialParams.tone = tone;
+	partialParams.vel_decay = vel_decay;
+	partialParams.vel_hit = vel_hit;
+	partialParams.vel_inharm = vel_inharm;
+	partialParams.vel_damp = vel_damp;
+	partialParams.vel_tone = vel_tone;
+	partialParams.srate = _srate;
 
 	waveguide.decay = decay;
 	waveguide.radius = radius;
@@ -50,20 +46,227 @@ void Resonator::setParams(double _srate, bool _on, int model, int _partials, dou
 	waveguide.srate = srate;
 	waveguide.vel_decay = vel_decay;
 	waveguide.rel = _rel;
+
+	selectKernel();
+}
+
+// picks the process kernel, the partials count is one of the choices mapped by onSlider()
+// and has a fixed size kernel built for the cpu selected in prepareToPlay
+void Resonator::selectKernel()
+{
+	if (isTube()) {
+		kernel = &Resonator::processWaveguide;
+		return;
+	}
+	auto full = bands[1] + bands[2] ? bands[0] : npartials;
+	int size = 0;
+	while (size < 7 && (1 << size) < full)
+		++size;
+	partialsKernel = size < 7 && (1 << size) == full ? Kernels::get().partials[size] : nullptr;
+	if (bands[1] + bands[2])
+		kernel = &Resonator::processBands;
+	else if (partialsKernel)
+		kernel = &Resonator::processPartials;
+	else
+		kernel = &Resonator::processPartialsN;
+}
+
+double Resonator::processWaveguide(double input)
+{
+	return tubeOutput(waveguide.process(tubeInput(input)));
+}
+
+double Resonator::processPartials(double input)
+{
+	return lagDelay.process(partialsKernel(bank, input));
+}
+
+double Resonator::processPartialsN(double input)
+{
+	return lagDelay.process(Kernels::get().partialsN(bank, input, 0, npartials));
+}
+
+// full rate lanes every sample, half rate lanes every second sample and quarter rate lanes every fourth,
+// the lower bands are decimated from the input and interpolated back, lagging by the halfband delays,
+// the full and half rate bands are delayed so all bands lag LAG samples
+double Resonator::processBands(double input)
+{
+	auto& kernels = Kernels::get();
+	auto half = bands[0] + bands[1];
+	auto out = lagDelay.process(partialsKernel ? partialsKernel(bank, input) : kernels.partialsN(bank, input, 0, bands[0]));
+
+	halfDown.push(input);
+	if ((bandPhase & 1) == 0) {
+		auto x = halfDown.decimate();
+		auto y = halfDelay.process(kernels.partialsN(bank, x, bands[0], half));
+		if (bands[2]) {
+			quarterDown.push(x);
+			if ((bandPhase & 2) == 0) {
+				quarterUp.push(kernels.partialsN(bank, quarterDown.decimate(), half, half + bands[2]));
+				y += quarterUp.even();
+			}
+			else {
+				y += quarterUp.odd();
+			}
+		}
+		halfUp.push(y);
+		out += halfUp.even();
+	}
+	else {
+		out += halfUp.odd();
+	}
+
+	bandPhase = (bandPhase + 1) & 3;
+	return out;
+}
+
+// sorts the partials lanes by rate band from their frequencies at the highest bend, full rate lanes first,
+// partials keep their state when they stay in their band, returns true if the bands changed
+bool Resonator::assignBands(double freq, double vel, const std::array<double, 64>& model)
+{
+	std::array<int, globals::MAX_PARTIALS> rates{};
+	std::array<int, 3> count{};
+	for (int i = 0; i < npartials; ++i) {
+		auto f = freq * model[i] * Partial::stretch(partialParams, model[i], vel) * maxBend;
+		int band = !lagDelay.getLength() ? 0 : f < srate * QUARTER_LIMIT ? 2 : f < srate * HALF_LIMIT ? 1 : 0;
+		rates[i] = 1 << band;
+		count[band] += 1;
+	}
+
+	// a band with few partials moves up, the quarter band runs on the half band stream
+	if (count[2] && count[2] < MIN_BAND_PARTIALS) {
+		count[1] += count[2];
+		count[2] = 0;
+	}
+	if (count[1] + count[2] < MIN_BAND_PARTIALS) {
+		count[0] = npartials;
+		count[1] = count[2] = 0;
+	}
+
+	double s1[globals::MAX_PARTIALS];
+	double s2[globals::MAX_PARTIALS];
+	std::copy(std::begin(bank.s1), std::end(bank.s1), s1);
+	std::copy(std::begin(bank.s2), std::end(bank.s2), s2);
+
+	std::array<int, 3> next{ 0, count[0], count[0] + count[1] };
+	for (int i = 0; i < globals::MAX_PARTIALS; ++i) {
+		auto& partial = partials[i];
+		auto rate = i >= npartials ? 1 : std::min(rates[i], count[2] ? 4 : count[1] ? 2 : 1);
+		auto lane = i >= npartials ? i : next[rate >> 1]++;
+		auto keep = rate == partial.rate;
+		bank.s1[lane] = keep ? s1[partial.lane] : 0.0;
+		bank.s2[lane] = keep ? s2[partial.lane] : 0.0;
+		partial.lane = lane;
+		partial.rate = rate;
+	}
+
+	auto changed = count != bands;
+	bands = count;
+	return changed;
+}
+
+// sets the lowpass or highpass cut filter coefficients
+// also used by the processor for the shared cut filter bus
+void Resonator::setCutFilter(Filter& f, double srate, double cut)
+{
+	auto freq = 20.0 * std::pow(20000.0 / 20.0, cut < 0.0 ? 1 + cut : cut); // map 1..0 to 20..20000, with inverse scale for negative norm;
+	if (cut < 0.0) {
+		f.lp(srate, freq, 0.707);
+	}
+	else {
+		f.hp(srate, freq, 0.707);
+	}
 }
 
 void Resonator::update(double freq, double vel, bool isRelease, double pitch_bend, std::array<double,64> model, std::array<double, 64> modelGain)
 {
+	auto trigger = triggered;
+	triggered = false;
+
+	// the lag and rate bands are set when the note is triggered, a ringing note keeps them
+	if (trigger && lagDelay.getLength() != (multirate ? LAG : 0))
+		lagDelay.setLength(multirate ? LAG : 0);
+
 	if (nmodel == OpenTube || nmodel == ClosedTube) {
+		waveguide.harmonic = false;
 		waveguide.update(model[0] * freq, vel, pitch_bend, isRelease);
+		return;
 	}
-	else {
-		for (Partial& partial : partials) {
-			auto idx = partial.k - 1; // clears warning when accessing model[k-1] directly
-			partial.update(freq, model[idx], model[model.size() - 1], vel, pitch_bend, isRelease);
-			partial.applyGain(modelGain[idx]);
-		}
+
+	// a new partials count moves lanes in and out of the bands so it is applied right away
+	auto banded = bands[0] + bands[1] + bands[2];
+	if ((trigger || banded != npartials) && assignBands(freq, vel, model)) {
+		halfDown.clear();
+		halfUp.clear();
+		quarterDown.clear();
+		quarterUp.clear();
+		selectKernel();
+	}
+
+	for (Partial& partial : partials) {
+		auto idx = partial.k - 1; // clears warning when accessing model[k-1] directly
+		partial.update(partialParams, bank, freq, model[idx], model[model.size() - 1], vel, pitch_bend, isRelease);
+		partial.applyGain(bank, modelGain[idx]);
 	}
+
+	// the partials stay tuned when the waveguide renders them, the sine oscillators follow their frequencies,
+	// the engine only changes on a trigger so param changes never cut a ringing note
+	auto harmonic = trigger ? harmonicTubes && isHarmonic(modelGain) : waveguide.harmonic;
+	if (harmonic != waveguide.harmonic) {
+		// the engine taken over starts from silence, its state is from an older note
+		if (harmonic) waveguide.clear();
+		std::fill(std::begin(bank.s1), std::end(bank.s1), 0.0);
+		std::fill(std::begin(bank.s2), std::end(bank.s2), 0.0);
+		waveguide.harmonic = harmonic;
+		selectKernel();
+	}
+	if (harmonic)
+		tuneWaveguide(vel, pitch_bend);
+}
+
+// the partials form a harmonic series when they sit within a cent of the fundamental multiples,
+// have the same model gain and ring no longer than the fundamental, inharmonicity and serial coupling shifts fail the check
+bool Resonator::isHarmonic(const std::array<double, 64>& modelGain) const
+{
+	if (partials[0].out_of_range)
+		return false;
+	for (int k = 1; k < npartials; ++k) {
+		auto& partial = partials[k];
+		if (partial.out_of_range)
+			continue;
+		if (fabs(partial.f_k / (partials[0].f_k * partial.k) - 1.0) > 0.0006
+			|| modelGain[k] != modelGain[0]
+			|| partialLoss(k, 1.0) > partialLoss(0, 1.0))
+			return false;
+	}
+	return true;
+}
+
+// calibrates the waveguide against the tuned partials, the loop losses from their decays
+// and the excitation from their amplitudes, hit position and tone
+void Resonator::tuneWaveguide(double vel, double pitch_bend)
+{
+	auto& p = partialParams;
+	auto f_1 = partials[0].f_k;
+	auto period = srate / f_1;
+
+	int last = 0;
+	for (int k = 1; k < npartials; ++k)
+		if (!partials[k].out_of_range) last = k;
+
+	// the loop lowpass matches the losses at the geometric middle of the partials, the one pole
+	// loss grows with the square of the frequency and the partials damping with up to its square
+	int m = std::max(1, (int)std::lround(sqrt(last + 1.0)) - 1);
+	auto loss_1 = partialLoss(0, period);
+	auto loss_m = last ? partialLoss(m, period) : loss_1;
+	waveguide.calibrate(f_1 / pitch_bend, pitch_bend, loss_1, loss_m, m + 1);
+
+	// same hit and tone as Partial::update(), the tone is a power of the partial frequency
+	auto hit = fmax(0.02, fmin(.5, p.hit + p.vel_hit * vel / 2.0));
+	auto tone_base = std::fmin(1.0, std::fmax(-1.0, p.tone + p.vel_tone * 2.0 * vel));
+	auto f_n = partials[last].f_k;
+	auto tone_ratio = pow(f_n / f_1, tone_base * 12 / 6);
+	waveguide.setExcitation(f_1, f_n, hit, tone_ratio, partialAmp(0));
 }
 
 void Resonator::applyPitchBend(double bend)
@@ -74,8 +277,10 @@ void Resonator::applyPitchBend(double bend)
 		}
 		else {
 			for (int p = 0; p < npartials; ++p) {
-				partials[p].applyPitchBend(bend);
+				partials[p].applyPitchBend(bank, bend);
 			}
+			if (waveguide.harmonic)
+				waveguide.applyPitchBend(bend);
 		}
 	}
 }
@@ -83,6 +288,7 @@ void Resonator::applyPitchBend(double bend)
 void Resonator::activate()
 {
 	active = true;
+	triggered = true;
 	silence = 0;
 }
 
@@ -90,17 +296,15 @@ double Resonator::process(double input)
 {
 	double out = 0.0;
 
-	if (active) { // use active and silence to turn off strings process if not in use
-		if (nmodel == OpenTube || nmodel == ClosedTube) {
-			out += waveguide.process(input); // waveguide process
-		}
-		else {
-			for (int p = 0; p < npartials; ++p) {
-				out += partials[p].process(input);
-			}
-		}	
-	}
+	if (active) // use active and silence to turn off strings process if not in use
+		out = (this->*kernel)(input);
 
+	return track(out, input);
+}
+
+// counts the samples of silence of a processed output, used directly when the output comes from the waveguides kernel
+double Resonator::track(double out, double input)
+{
 	if (fabs(out) + fabs(input) > 0.00001)
 		silence = 0;
 	else
@@ -114,9 +318,15 @@ double Resonator::process(double input)
 
 void Resonator::clear()
 {
-	for (Partial& partial : partials) {
-		partial.clear();
-	}
+	std::fill(std::begin(bank.s1), std::end(bank.s1), 0.0);
+	std::fill(std::begin(bank.s2), std::end(bank.s2), 0.0);
 	waveguide.clear();
-	filter.clear(0.0);
+	filter.clear();
+	halfDown.clear();
+	halfUp.clear();
+	quarterDown.clear();
+	quarterUp.clear();
+	lagDelay.clear();
+	halfDelay.clear();
+	bandPhase = 0;
 }
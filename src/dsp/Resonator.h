@@ -2,6 +2,9 @@
 // Resonator holds a number of Partials and a Waveguide
 // depending on the selected model uses the Partials bank or Waveguide to process input
 // the partials are tuned by selected model by Voice.h
+// harmonic models can be rendered by the Waveguide instead, calibrated against the partials
+// with multirate on the low partials run at half or quarter rate between Halfband filters,
+// the bands are delayed to the quarter band lag and resonators without bands lag the same
 
 #pragma once
 #include <vector>
@@ -10,6 +13,8 @@
 #include "Partial.h"
 #include "Waveguide.h"
 #include "Filter.h"
+#include "Halfband.h"
+#include "Delay.h"
 #include "Models.h"
 
 class Resonator
@@ -22,14 +27,22 @@ public:
 		double rel, double inharm, double cut,double radius, double vel_decay, double vel_hit, double vel_inharm, 
 		double vel_damp, double vel_tone);
 
+	static void setCutFilter(Filter& f, double srate, double cut);
 	void activate();
 	void update(double frequency, double vel, bool isRelease, double pitch_bend, std::array<double, 64> _model, std::array<double, 64> modelGain);
 	void clear();
 	double process(double x);
+	double track(double out, double input);
+	bool isTube() const { return nmodel == OpenTube || nmodel == ClosedTube || waveguide.harmonic; }
+
+	// input and output of the tube lane, a harmonic model shapes the input and outputs it directly as the first pulse
+	double tubeInput(double input) { return waveguide.harmonic ? waveguide.excite(input) : input; }
+	double tubeOutput(double out) { return lagDelay.process(waveguide.harmonic ? out + waveguide.excitation : out); }
 	void applyPitchBend(double bend);
 
 	int silence = 0; // counter of samples of silence
 	bool active = false; // returns to false if samples of silence run for a bit
+	bool triggered = false; // set by activate(), the update that follows a trigger may switch the engine and the rate bands
 	double srate = 0.0;
 	bool on = false;
 	int nmodel = 0;
@@ -37,12 +50,54 @@ public:
 	double decay = 0.0;
 	double radius = 0.0;
 	double cut = 0.0;
+	bool harmonicTubes = false; // render harmonic models with the waveguide
+	bool multirate = false; // run the low partials at a lower rate
+	double maxBend = 1.0; // highest pitch bend factor, banded partials stay under their band limit when bent
+
+	// output lag of a resonator triggered with multirate on, the quarter band goes through four halfbands
+	// of DELAY samples at the host rate and two at half rate
+	static constexpr int LAG = 6 * Halfband::DELAY;
 
-	std::vector<Partial> partials;
+	PartialBank bank{}; // filter coefficients and state of the partials, read every sample
+	PartialParams partialParams{}; // params shared by the partials, read when they are tuned
+	std::array<Partial, globals::MAX_PARTIALS> partials; // stored inline so a voice is one block of memory
 	Waveguide waveguide{};
 	Filter filter{};
 
 private:
+	using Kernel = double (Resonator::*)(double input);
+	using PartialsKernel = double (*)(PartialBank& bank, double input);
+	Kernel kernel = &Resonator::processPartialsN; // selected by setParams() from the model and partials count
+	PartialsKernel partialsKernel = nullptr; // fixed size partials loop from the cpu kernels
+
+	// partials with a frequency under these fractions of the sample rate can run at half or quarter rate,
+	// the limits are the halfband passband of each stage
+	static constexpr double HALF_LIMIT = 0.2;
+	static constexpr double QUARTER_LIMIT = 0.1;
+	static constexpr int MIN_BAND_PARTIALS = 8; // fewer partials in a band don't pay for its filters
+
+	std::array<int, 3> bands{}; // lanes count of the full, half and quarter rate bands
+	int bandPhase = 0; // host rate sample counter modulo 4
+	Halfband halfDown{};
+	Halfband halfUp{};
+	Halfband quarterDown{};
+	Halfband quarterUp{};
+	Delay<LAG> lagDelay{ 0 }; // full rate band, or the whole output without bands, LAG long with multirate on and 0 without
+	Delay<2 * Halfband::DELAY> halfDelay{}; // half rate band in half rate samples, the quarter band filters lag at half rate
+
+	void selectKernel();
+	bool isHarmonic(const std::array<double, 64>& modelGain) const;
+	void tuneWaveguide(double vel, double pitch_bend);
+	double processWaveguide(double input);
+	double processPartials(double input);
+	double processPartialsN(double input);
+	double processBands(double input);
+	bool assignBands(double freq, double vel, const std::array<double, 64>& model);
+
+	// loss of a partial over a number of samples at the host rate, its pole radius is sqrt(a2),
+	// and its impulse amplitude at the host rate
+	double partialLoss(int k, double samples) const { return pow(bank.a2[partials[k].lane], samples / partials[k].rate * 0.5); }
+	double partialAmp(int k) const { return 2.0 * bank.b0[partials[k].lane] / partials[k].rate; }
 
 };
 
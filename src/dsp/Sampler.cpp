@@ -24,19 +24,44 @@ void Sampler::setPitch(double semis)
 	pitchfactor = std::pow(2.0, (semis / 12.0));
 }
 
+// exchanges the loaded waveforms without allocating
+// used by the audio thread to receive samples decoded in the message thread
+void Sampler::swap(Sampler& other)
+{
+	std::swap(waveform, other.waveform);
+	std::swap(wavesrate, other.wavesrate);
+	std::swap(isUserFile, other.isUserFile);
+}
+
 void Sampler::loadEncoded(String encoded)
 {
-	waveform.clear();
 	juce::MemoryBlock block;
 	block.fromBase64Encoding(encoded);
+	loadData(block);
+}
+
+// loads a waveform previously written by getData()
+void Sampler::loadData(const juce::MemoryBlock& block)
+{
+	waveform.clear();
+	waveform.reserve(block.getSize() / sizeof(double));
 
 	juce::MemoryInputStream mi(block, false);
-	while (mi.getNumBytesRemaining() >= sizeof(double))
+	while (mi.getNumBytesRemaining() >= (juce::int64)sizeof(double))
 		waveform.push_back(mi.readDouble());
 
 	isUserFile = true;
 }
 
+juce::MemoryBlock Sampler::getData() const
+{
+	juce::MemoryOutputStream mo(waveform.size() * sizeof(double));
+	for (auto s : waveform)
+		mo.writeDouble(s);
+
+	return mo.getMemoryBlock();
+}
+
 void Sampler::loadSample(String path)
 {
 	File audioFile(path);
@@ -110,7 +135,7 @@ void Sampler::loadSampleFromBinary(std::unique_ptr<juce::InputStream> stream)
 	}
 }
 
-double Sampler::waveLerp(double pos)
+double Sampler::waveLerp(double pos) const
 {
 	int i = (int)pos;
 	double frac = pos - i;
@@ -119,7 +144,7 @@ double Sampler::waveLerp(double pos)
 	return (1.0 - frac) * waveform[i] + frac * waveform[j];
 }
 
-double Sampler::waveCubic(double pos)
+double Sampler::waveCubic(double pos) const
 {
 	int N = (int)waveform.size();
 	int i1 = (int)pos;
@@ -20,12 +20,15 @@ public:
 	~Sampler() {};
 
 	void loadEncoded(juce::String encoded);
+	void loadData(const juce::MemoryBlock& block);
+	juce::MemoryBlock getData() const;
 	void loadSample(juce::String filepath);
 	void loadInternalSample(MalletType type);
 	void loadSampleFromBinary(std::unique_ptr<juce::InputStream> stream);
-	double waveLerp(double pos);
-	double waveCubic(double pos);
+	double waveLerp(double pos) const;
+	double waveCubic(double pos) const;
 	void setPitch(double semis);
+	void swap(Sampler& other);
 
 	// sample mallet fields
 	std::vector<double> waveform = {};
@@ -0,0 +1,91 @@
+// Copyright 2025 tilr
+// Coupled form sine bank, renders the sum of the oscillators per block through the selected kernels
+
+#include "SineBank.h"
+#include <algorithm>
+#include <cmath>
+#include <JuceHeader.h>
+#include "Kernels.h"
+
+// sets the oscillators frequencies from the partials, keeps the current phases
+// the samples rendered ahead with the previous frequencies are dropped
+void SineBank::tune(const Partial* partials, int npartials, double srate)
+{
+	rewind();
+	size = std::min(globals::MAX_PARTIALS, (npartials + 3) & ~3);
+	for (int i = 0; i < globals::MAX_PARTIALS; ++i) {
+		if (i < npartials && !partials[i].out_of_range) {
+			auto omega = juce::MathConstants<double>::twoPi * partials[i].f_k / srate;
+			rotCos[i] = std::cos(omega);
+			rotSin[i] = std::sin(omega);
+			gain[i] = 1.0;
+		}
+		else {
+			rotCos[i] = 1.0;
+			rotSin[i] = 0.0;
+			gain[i] = 0.0;
+		}
+	}
+}
+
+void SineBank::reset()
+{
+	size = 0;
+	renormCounter = 0;
+	pos = BLOCK;
+	for (int i = 0; i < globals::MAX_PARTIALS; ++i) {
+		sn[i] = 0.0;
+		cs[i] = 1.0;
+		rotCos[i] = 1.0;
+		rotSin[i] = 0.0;
+		gain[i] = 0.0;
+	}
+}
+
+// returns the sum of all oscillators for the next sample
+double SineBank::process()
+{
+	if (pos == BLOCK)
+		render();
+	return block[pos++];
+}
+
+// renders the next block, the state at its start is kept to rewind it on a retune
+void SineBank::render()
+{
+	if (renormCounter >= RENORM_INTERVAL) {
+		renormCounter = 0;
+		renormalize();
+	}
+	std::copy(sn, sn + size, sn0);
+	std::copy(cs, cs + size, cs0);
+	Kernels::get().sineBank(sn, cs, rotCos, rotSin, gain, size, block, BLOCK);
+	renormCounter += BLOCK;
+	pos = 0;
+}
+
+// moves the oscillators back to the last sample read, replaying the read samples from the block start
+// gives the same phases as advancing one sample at a time
+void SineBank::rewind()
+{
+	if (pos == BLOCK)
+		return;
+	std::copy(sn0, sn0 + size, sn);
+	std::copy(cs0, cs0 + size, cs);
+	double skipped[BLOCK];
+	if (pos > 0)
+		Kernels::get().sineBank(sn, cs, rotCos, rotSin, gain, size, skipped, pos);
+	renormCounter -= BLOCK - pos;
+	pos = BLOCK;
+}
+
+// rounding errors slowly grow or shrink the rotations amplitude,
+// one newton step of 1/sqrt(r) is enough as the drift between corrections is tiny
+void SineBank::renormalize()
+{
+	for (int i = 0; i < globals::MAX_PARTIALS; ++i) {
+		auto g = 1.5 - 0.5 * (sn[i] * sn[i] + cs[i] * cs[i]);
+		sn[i] *= g;
+		cs[i] *= g;
+	}
+}
@@ -0,0 +1,42 @@
+// Copyright 2025 tilr
+// Bank of sine oscillators tuned to the partials of a resonator
+// each oscillator is a coupled form rotation (sin, cos) so there are no phase wraps or table lookups,
+// the state is kept in plain arrays so the loop over all oscillators can be vectorized,
+// the sum is rendered BLOCK samples ahead and read back one sample at a time by the voice
+
+#pragma once
+#include <vector>
+#include "Partial.h"
+#include "../Globals.h"
+
+class SineBank
+{
+public:
+	SineBank() { reset(); };
+	~SineBank() {};
+
+	void tune(const Partial* partials, int npartials, double srate);
+	void reset();
+	double process();
+
+	static constexpr int RENORM_INTERVAL = 1024; // samples between amplitude corrections of the rotations
+	static constexpr int BLOCK = 32; // samples rendered ahead
+
+private:
+	int size = 0; // number of lanes processed, npartials rounded up to 4
+	int renormCounter = 0;
+	int pos = BLOCK; // next sample read from the rendered block
+	alignas(32) double sn[globals::MAX_PARTIALS]; // sin state
+	alignas(32) double cs[globals::MAX_PARTIALS]; // cos state
+	alignas(32) double sn0[globals::MAX_PARTIALS]; // sin state at the start of the rendered block
+	alignas(32) double cs0[globals::MAX_PARTIALS]; // cos state at the start of the rendered block
+	alignas(32) double rotCos[globals::MAX_PARTIALS]; // cos of angular frequency
+	alignas(32) double rotSin[globals::MAX_PARTIALS]; // sin of angular frequency
+	alignas(32) double gain[globals::MAX_PARTIALS]; // zero for partials out of range
+
+	alignas(32) double block[BLOCK]; // summed output of the rendered block
+
+	void render();
+	void rewind();
+	void renormalize();
+};
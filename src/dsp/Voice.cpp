@@ -34,7 +34,7 @@ void Voice::trigger(uint64_t timestamp, double _srate, int _note, double _vel, M
 	if (skip_fadeout) {
 		triggerStart(false);
 	}
-	else if (((resA.on && resA.active) || (resB.on && resB.active))) {
+	else if (isResonating()) {
 		isFading = true;
 		fadeTotalSamples = (int)(globals::REPEAT_NOTE_FADE_MS * 0.001 * srate);
 		fadeSamples = fadeTotalSamples;
@@ -87,6 +87,23 @@ void Voice::clear()
 	noise.clear();
 	resA.clear();
 	resB.clear();
+	bInput.clear();
+}
+
+// returns true while a resonator rings, a new note fades it out first
+bool Voice::isResonating() const
+{
+	return (resA.on && resA.active) || (resB.on && resB.active);
+}
+
+// returns true while the voice is producing or may still produce sound
+bool Voice::isActive() const
+{
+	return isFading
+		|| mallet.isActive()
+		|| noise.isActive()
+		|| (resA.on && resA.active)
+		|| (resB.on && resB.active);
 }
 
 void Voice::setCoupling(bool _couple, double _split) {
@@ -119,16 +136,24 @@ void Voice::applyPitchBend(double bend)
 		pitchBend = bend;
 		if (resA.on) resA.applyPitchBend(bend);
 		if (resB.on) resB.applyPitchBend(bend);
+		oscillatorsDetuned = true; // retuned once per block and only while the noise oscillators are used
 	}
 }
 
+// retunes the sine oscillators after the partials frequencies change
+void Voice::tuneOscillators()
+{
+	aOscillators.tune(resA.partials.data(), resA.on ? resA.npartials : 0, srate);
+	bOscillators.tune(resB.partials.data(), resB.on ? resB.npartials : 0, srate);
+	oscillatorsDetuned = false;
+}
+
 // processes an array of sinewave oscillators
 // one for each partial
 // used to excite resonators without the grainy sound of noise
 double Voice::processOscillators(bool isA)
 {
 	auto& res = isA ? resA : resB;
-	auto& phases = isA ? aPhases : bPhases;
 
 	double final = 0.0;
 	if (!res.on) return final;
@@ -136,21 +161,15 @@ double Voice::processOscillators(bool isA)
 	bool isTube = res.nmodel == OpenTube || res.nmodel == ClosedTube;
 
 	if (isTube) {
-		phases[0] += res.waveguide.f_k / srate;
-		if (phases[0] > 1.0) phases[0] -= 1.0;
+		auto& phase = isA ? aTubePhase : bTubePhase;
+		phase += res.waveguide.f_k / srate;
+		if (phase > 1.0) phase -= 1.0;
 		final += res.nmodel == OpenTube 
-			? phases[0] * -2 + 1 // saw wave produces the same harmonics as open tube
-			: phases[0] < 0.5 ? -1 : 1; // square wave produces sames harmonitcs as closed tube
+			? phase * -2 + 1 // saw wave produces the same harmonics as open tube
+			: phase < 0.5 ? -1 : 1; // square wave produces sames harmonitcs as closed tube
 	}
 	else {
-		for (int i = 0; i < res.npartials; i++) {
-			auto& partial = res.partials[i];
-			if (!partial.out_of_range) {
-				phases[i] += partial.f_k / srate;
-				if (phases[i] > 1.0) phases[i] -= 1.0;
-				final += Partial::sinLUT(phases[i]);
-			}
-		}
+		final += isA ? aOscillators.process() : bOscillators.process();
 	}
 
 	final *= isTube ? 0.125 : 0.004; // gain normalization set by hear
@@ -193,30 +212,38 @@ std::tuple<std::array<double, 64>, std::array<double,64>> Voice::calcFrequencySh
 	return std::tuple<std::array<double,64>, std::array<double,64>> (aShifts, bShifts);
 }
 
+// copies the shared models of the resonators, called when the voice receives the current params
+void Voice::loadModels()
+{
+	aModel = models.aModels[resA.nmodel];
+	bModel = models.bModels[resB.nmodel];
+	aGain = models.getGains((ModalModels)resA.nmodel);
+	bGain = models.getGains((ModalModels)resB.nmodel);
+}
+
 void Voice::updateResonators()
 {
-	std::array<double,64> aModel = models.aModels[resA.nmodel];
-	std::array<double,64> bModel = models.bModels[resB.nmodel];
-	std::array<double, 64> aGain = models.getGains((ModalModels)resA.nmodel);
-	std::array<double, 64> bGain = models.getGains((ModalModels)resB.nmodel);
+	std::array<double,64> aRatios = aModel;
+	std::array<double,64> bRatios = bModel;
 
 	if (resA.nmodel == ModalModels::Djembe) {
-		aModel = models.calcDjembe(freq, a_ratio);
+		aRatios = models.calcDjembe(freq, a_ratio);
 	}
 	if (resB.nmodel == ModalModels::Djembe) {
-		bModel = models.calcDjembe(freq, b_ratio);
+		bRatios = models.calcDjembe(freq, b_ratio);
 	}
 
-	if (aPitchFactor != 1.0) applyPitch(aModel, aPitchFactor);
-	if (bPitchFactor != 1.0) applyPitch(bModel, bPitchFactor);
+	if (aPitchFactor != 1.0) applyPitch(aRatios, aPitchFactor);
+	if (bPitchFactor != 1.0) applyPitch(bRatios, bPitchFactor);
 
 	// if coupling mode is serial apply frequency splitting
 	if (couple && resA.on && resB.on) {
-		auto [aShifts, bShifts] = calcFrequencyShifts(aModel, bModel);
-		aModel = aShifts;
-		bModel = bShifts;
+		auto [aShifts, bShifts] = calcFrequencyShifts(aRatios, bRatios);
+		aRatios = aShifts;
+		bRatios = bShifts;
 	}
 
-	if (resA.on) resA.update(freq, vel, isRelease, pitchBend, aModel, aGain);
-	if (resB.on) resB.update(freq, vel, isRelease, pitchBend, bModel, bGain);
+	if (resA.on) resA.update(freq, vel, isRelease, pitchBend, aRatios, aGain);
+	if (resB.on) resB.update(freq, vel, isRelease, pitchBend, bRatios, bGain);
+	tuneOscillators();
 }
@@ -9,6 +9,7 @@
 #include "Mallet.h"
 #include "Noise.h"
 #include "Resonator.h"
+#include "SineBank.h"
 #include "tuple"
 #include "libMTSClient.h"
 
@@ -17,7 +18,25 @@ class Sampler;
 
 using namespace std::chrono;
 
-class Voice
+// Output levels of a voice, copied with the voice params
+// so a voice ringing with the previous program keeps its mix and gain
+struct VoiceMix
+{
+	double mallet_mix = 0.0;
+	double mallet_res = 0.0;
+	double vel_mallet_mix = 0.0;
+	double vel_mallet_res = 0.0;
+	double noise_osc = 0.0;
+	float noise_mix = 0.0f; // normalized
+	float noise_res = 0.0f; // normalized
+	float vel_noise_mix = 0.0f;
+	float vel_noise_res = 0.0f;
+	double a_level = 1.0; // resonator A output with the A+B mix and gain, zero with serial coupling
+	double b_level = 1.0;
+};
+
+// aligned to the cache line so voices stored next to each other never share a line
+class alignas(64) Voice
 {
 public:
 	Voice(Models& m, Sampler& s) : models(m), mallet(s) {}
@@ -29,10 +48,12 @@ public:
 	double fadeOut();
 	void release(uint64_t timestamp);
 	void clear();
+	bool isActive() const;
 	void setPitch(double a_coarse, double b_coarse, double a_fine, double b_fine, double pitch_bend);
 	void setRatio(double _a_ratio, double _b_ratio);
 	void applyPitch(std::array<double, 64>& model, double factor);
 	void applyPitchBend(double bend);
+	void tuneOscillators();
 	double processOscillators(bool isA);
 	double inline freqShift(double fa, double fb) const;
 	std::tuple<std::array<double, 64>, std::array<double, 64>> calcFrequencyShifts(
@@ -40,7 +61,9 @@ public:
 		std::array<double, 64>& bModel
 	);
 	void setCoupling(bool _couple, double _split);
+	void loadModels();
 	void updateResonators();
+	bool isResonating() const;
 
 	int note = 0;
 	double freq = 0.0;
@@ -48,6 +71,8 @@ public:
 	bool isRelease = false;
 	bool isPressed = false; // used for audioIn
 	bool couple = false;
+	bool pendingParams = false; // voice kept ringing with the previous program params
+	VoiceMix mix{};
 	double malletKtrack = 0.0;
 	double split = 0.0;
 	double srate = 44100.0;
@@ -69,14 +94,24 @@ public:
 	double aPitchFactor = 1.0;
 	double bPitchFactor = 1.0;
 	double pitchBend = 1.0;
+	bool oscillatorsDetuned = false; // the partials followed the pitch bend but the sine oscillators did not
 
 	Mallet mallet;
 	Noise noise{};
 	Resonator resA{};
 	Resonator resB{};
+	Delay<Resonator::LAG> bInput{ 0 }; // input of B when A does not feed it, lags like the A output with multirate on
 
 private:
 	Models& models;
-	std::array<double, 64> aPhases = {};
-	std::array<double, 64> bPhases = {};
+	// model ratios and gains of the resonators, copied with the voice params so a voice
+	// ringing with the previous program keeps its models when the shared ones are recalculated
+	std::array<double, 64> aModel{};
+	std::array<double, 64> bModel{};
+	std::array<double, 64> aGain{};
+	std::array<double, 64> bGain{};
+	SineBank aOscillators{};
+	SineBank bOscillators{};
+	double aTubePhase = 0.0;
+	double bTubePhase = 0.0;
 };
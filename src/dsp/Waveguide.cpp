@@ -5,57 +5,186 @@
 void Waveguide::update(double f_0, double vel, double pitch_bend, bool isRelease)
 {
 	base_freq = f_0;
-	f_k = base_freq * pitch_bend;
-	auto tlen = srate / f_k;
-	if (is_closed) tlen *= 0.5; // fix closed tube one octave lower
-	read_ptr_frac = write_ptr - tlen;
-	if (read_ptr_frac < 0) read_ptr_frac += tube_len;
+	loop_delay = 0.0;
+	setReadPos(pitch_bend);
 
 	auto decay_k = fmin(100.0, exp(log(decay) + vel * vel_decay * (log(100) - log(0.01))));
 	if (isRelease) decay_k *= rel;
-	tube_decay = decay_k
+	auto tube_decay = decay_k
 		? exp(-juce::MathConstants<double>::pi / base_freq / (srate * decay_k / 125000)) // 125000 set by hear so that decay approximates in seconds
 		: 0.0;
+	lanes->gain[lane] = is_closed ? -tube_decay : tube_decay; // closed tube: only odd harmonics
+	lanes->radius[lane] = radius;
 }
 
 void Waveguide::applyPitchBend(double pitch_bend)
+{
+	setReadPos(pitch_bend);
+}
+
+// Compute fractional read position
+void Waveguide::setReadPos(double pitch_bend)
 {
 	f_k = base_freq * pitch_bend;
+	auto len = lanes->length[lane];
 	auto tlen = srate / f_k;
 	if (is_closed) tlen *= 0.5; // fix closed tube one octave lower
+	tlen -= loop_delay;
+	tlen = fmin(tlen, len - 2.0);
+
+	auto pos = lanes->writePos[lane] - tlen;
+	if (pos < 0) pos += len;
+	lanes->readPos[lane] = pos;
+}
+
+// tunes the tube to a harmonic modal model, loss_1 and loss_m are the partials amplitude losses over one period
+// at the fundamental and at harmonic m, the radius lowpass is solved so the loop matches their ratio
+void Waveguide::calibrate(double f_0, double pitch_bend, double loss_1, double loss_m, int m)
+{
+	base_freq = f_0;
+	auto w_1 = juce::MathConstants<double>::twoPi * f_0 / srate;
+	auto w_m = fmin(juce::MathConstants<double>::pi, w_1 * m);
+	auto response = [](double r, double w) {
+		auto c = 1.0 - r;
+		return r / sqrt(1.0 - 2.0 * c * cos(w) + c * c);
+	};
+
+	// the loop gain stays below one, which sets the lowest radius that still passes the fundamental loss
+	auto bisect = [](double lo, double hi, auto&& above) {
+		for (int i = 0; i < 40; ++i) {
+			auto mid = (lo + hi) * 0.5;
+			if (above(mid)) hi = mid;
+			else lo = mid;
+		}
+		return hi;
+	};
+	auto r_min = bisect(0.01, 1.0, [&](double r) { return response(r, w_1) * MAX_LOOP_GAIN >= loss_1; });
+
+	// the response ratio grows with the radius, a one pole can only reach a limited slope
+	auto r = 1.0;
+	auto target = loss_1 > 0.0 ? loss_m / loss_1 : 1.0;
+	if (target < 1.0)
+		r = bisect(r_min, 1.0, [&](double r) { return response(r, w_m) / response(r, w_1) > target; });
+
+	auto c = 1.0 - r;
+	loop_delay = atan2(c * sin(w_1), 1.0 - c * cos(w_1)) / w_1;
+	setReadPos(pitch_bend);
 
-	// Compute fractional read position
-	read_ptr_frac = write_ptr - tlen;
-	if (read_ptr_frac < 0) read_ptr_frac += tube_len;
+	// the linear interpolation of the read position also loses some of the fundamental each period
+	auto frac = lanes->readPos[lane] - (int)lanes->readPos[lane];
+	auto interp = sqrt(1.0 - 2.0 * frac * (1.0 - frac) * (1.0 - cos(w_1)));
+	lanes->radius[lane] = r;
+	lanes->gain[lane] = fmin(MAX_LOOP_GAIN, loss_1 / (response(r, w_1) * interp));
 }
 
+// shapes the excitation of a harmonic tube like the partials amplitudes,
+// a comb at the hit position, a lowpass above the last partial and a tone tilt from the fundamental to the last partial
+// amp_1 is the fundamental partial amplitude the tube output is normalized to
+void Waveguide::setExcitation(double f_1, double f_n, double hit, double tone_ratio, double amp_1)
+{
+	auto period = srate / f_1;
+	comb_delay = fmin(hit * period, comb_length - 1.0);
+
+	// 4th order butterworth lowpass in two sections
+	auto cutoff = fmin(20000.0, f_n + f_1 * 0.5);
+	shaper.lp(srate, cutoff, 0.5412, 0);
+	shaper.lp(srate, cutoff, 1.3066, 1);
+
+	// two first order shelves centered between the fundamental and the last partial,
+	// their spread is solved so the tilt across the partials matches the tone ratio
+	auto warp = [this](double f) { return 2.0 * srate * tan(juce::MathConstants<double>::pi * fmin(f / srate, 0.49)); };
+	auto w_1 = warp(f_1);
+	auto w_n = warp(fmax(f_n, f_1));
+	auto w_c = sqrt(w_1 * w_n);
+	auto tilt = sqrt(tone_ratio); // each shelf does half the tilt
+	auto cut = tilt < 1.0; // the zero goes above the pole to cut the highs, below it to boost them
+	auto shelf = [](double w, double z, double p) { return sqrt((w * w + z * z) / (w * w + p * p)); };
+	auto z = w_c;
+	auto p = w_c;
+	if (tilt != 1.0 && w_n > w_1) {
+		double lo = 0.0;
+		double hi = 10.0; // log of the spread between zero and pole
+		for (int i = 0; i < 40; ++i) {
+			auto spread = exp((lo + hi) * 0.5);
+			z = cut ? w_c * spread : w_c / spread;
+			p = cut ? w_c / spread : w_c * spread;
+			auto ratio = shelf(w_n, z, p) / shelf(w_1, z, p);
+			if (cut ? ratio > tilt : ratio < tilt) lo = (lo + hi) * 0.5;
+			else hi = (lo + hi) * 0.5;
+		}
+	}
+
+	// bilinear transform of (s + z) / (s + p)
+	auto k = 2.0 * srate;
+	for (int i = 2; i < 4; ++i)
+		shaper.setCoefs((k + z) / (k + p), (z - k) / (k + p), 0.0, (p - k) / (k + p), 0.0, i);
+
+	// a pulse train of period L holds harmonics of amplitude 2 / L, normalize the fundamental to the partial
+	auto shelf_1 = shelf(w_1, z, p);
+	auto comb_1 = 2.0 * sin(juce::MathConstants<double>::pi * hit);
+	excite_gain = amp_1 * period / (2.0 * comb_1 * shelf_1 * shelf_1);
+}
+
+// shapes the input of a harmonic tube, x[n] - x[n - hit * period] removes the harmonics with a node at the hit position
+double Waveguide::excite(double input)
+{
+	comb[comb_pos] = input;
+	auto read = comb_pos - comb_delay;
+	if (read < 0) read += comb_length;
+	int i0 = (int)read;
+	int i1 = (i0 + 1) & (comb_length - 1);
+	double frac = read - i0;
+	auto delayed = comb[i0] * (1.0 - frac) + comb[i1] * frac;
+	comb_pos = (comb_pos + 1) & (comb_length - 1);
+
+	excitation = shaper.processSerial((input - delayed) * excite_gain);
+	return excitation;
+}
+
+// processes this waveguide alone, the processor runs the tubes of all voices with the waveguides kernel
 double Waveguide::process(double input)
 {
-	int i0 = (int)read_ptr_frac;
-	int i1 = (i0 + 1) % tube_len;
-	double frac = read_ptr_frac - i0;
+	auto tube = lanes->tube[lane];
+	auto len = lanes->length[lane];
+	auto mask = len - 1;
+	auto read = lanes->readPos[lane];
+	auto write = lanes->writePos[lane];
+
+	int i0 = (int)read;
+	int i1 = (i0 + 1) & mask;
+	double frac = read - i0;
 	double sample = tube[i0] * (1.0 - frac) + tube[i1] * frac;
 
 	// Apply lowpass filter for frequency damping (tube radius)
-	y = radius * sample + (1.0 - radius) * y1;
-	y1 = y;
+	auto radius_k = lanes->radius[lane];
+	auto y = radius_k * sample + (1.0 - radius_k) * lanes->y1[lane];
+	lanes->y1[lane] = y;
 
 	// Apply decay to sample
-	auto dsample = y * tube_decay;
-	if (is_closed) dsample *= -1.0; // closed tube: only odd harmonics
-	tube[write_ptr] = input + dsample;
+	auto dsample = y * lanes->gain[lane];
+	tube[write] = input + dsample;
 
 	// Increment pointers
-	write_ptr = (write_ptr + 1) % tube_len;
-	read_ptr_frac += 1.0;
-	if (read_ptr_frac >= tube_len) read_ptr_frac -= tube_len;
+	write = (write + 1) & mask;
+	lanes->wrapped[lane] |= write == 0;
+	lanes->writePos[lane] = write;
+	read += 1.0;
+	if (read >= len) read -= len;
+	lanes->readPos[lane] = read;
 
 	return dsample;
 }
 
 void Waveguide::clear()
 {
-	y = y1 = write_ptr = 0;
-	read_ptr_frac = 0.0;
-	std::fill_n(tube.get(), tube_len, 0.0);
-}
\ No newline at end of file
+	// the tube is written from the start after a clear, only the written part needs zeroing
+	std::fill_n(lanes->tube[lane], lanes->wrapped[lane] ? lanes->length[lane] : lanes->writePos[lane], 0.0);
+	lanes->y1[lane] = 0.0;
+	lanes->writePos[lane] = 0;
+	lanes->wrapped[lane] = false;
+	lanes->readPos[lane] = 0.0;
+	std::fill_n(comb, comb_length, 0.0);
+	comb_pos = 0;
+	shaper.clear();
+	excitation = 0.0;
+}
@@ -1,23 +1,62 @@
 // Copyright 2025 tilr
 // Waveguide for OpenTube and ClosedTube models
+// the per sample state lives in a lane of WaveguideLanes so the processor can run all voices tubes together
+// harmonic modal models can also be rendered by the tube, calibrated against their partials
 #pragma once
-#include <memory>
 #include "../Globals.h"
+#include "WaveguideLanes.h"
+#include "BiquadBank.h"
 
 class Waveguide
 {
 public:
-	Waveguide() {
-		tube = std::make_unique<double[]>(20000); // Heap allocation
-	};
+	Waveguide() {};
 	~Waveguide() {};
 
+	static constexpr double MIN_FREQ = 10.0; // lowest tube frequency, lower notes are clamped to the tube length
+	static constexpr double MAX_LOOP_GAIN = 0.99999; // the radius lowpass passes dc, the loop gain is its gain there
+
+	// delay line size for a sample rate, a power of two so positions wrap with a mask
+	static int tubeLength(double srate)
+	{
+		int size = 1;
+		while (size < (int)(srate / MIN_FREQ) + 2) size <<= 1;
+		return size;
+	}
+
+	// memory used by one waveguide, the tube followed by the hit comb of harmonic models
+	static int arenaLength(int length) { return length + length / 2; }
+
+	// the delay line memory and lanes are owned by the processor, all voices tubes are kept in one block
+	// buffer holds arenaLength(length) samples
+	void setTube(WaveguideLanes* _lanes, int _lane, double* buffer, int length)
+	{
+		lanes = _lanes;
+		lane = _lane;
+		comb = buffer + length;
+		comb_length = length / 2;
+		comb_pos = 0;
+		lanes->tube[lane] = buffer;
+		lanes->length[lane] = length;
+		lanes->writePos[lane] = 0;
+		lanes->wrapped[lane] = false;
+		lanes->readPos[lane] = 0.0;
+		lanes->y1[lane] = 0.0;
+	}
+
 	void update(double f_0, double vel, double pitch_bend, bool isRelease);
 	double process(double input);
 	void clear();
 
 	void applyPitchBend(double bend);
 
+	// harmonic modal models rendered by the tube
+	void calibrate(double f_0, double pitch_bend, double loss_1, double loss_m, int m);
+	void setExcitation(double f_1, double f_n, double hit, double tone_ratio, double amp_1);
+	double excite(double input);
+
+	bool harmonic = false; // the tube renders a harmonic modal model
+	double excitation = 0.0; // last shaped input, output directly as the first pulse of a harmonic tube
 	double base_freq = 1000.0;
 	bool is_closed = false;
 	double srate = 0.0;
@@ -29,11 +68,17 @@ public:
 	double f_k = 0.0;
 
 private:
-	double read_ptr_frac = 0.0;
-	int write_ptr = 0;
-	double tube_decay = 0.0;
-	std::unique_ptr<double[]> tube;
-	int tube_len = 20000; // buffer size, 20000 allows for 10Hz at 200k srate (max_size = srate / freq_min)
-	double y = 0.0;
-	double y1 = 0.0;
+	WaveguideLanes* lanes = nullptr;
+	int lane = 0;
+	double loop_delay = 0.0; // phase delay of the radius lowpass at the fundamental, taken from the tube length
+
+	// excitation of harmonic models, hit position comb followed by the band limit and tone shelves
+	double* comb = nullptr;
+	int comb_length = 0; // power of two, half the tube length
+	int comb_pos = 0;
+	double comb_delay = 0.0;
+	double excite_gain = 0.0;
+	BiquadBank<double, 4> shaper{};
+
+	void setReadPos(double pitch_bend);
 };
\ No newline at end of file
@@ -0,0 +1,20 @@
+// Copyright 2025 tilr
+// State of the waveguides of all voices in lanes, one lane per voice,
+// so the tubes of every voice advance together in one loop each sample
+
+#pragma once
+#include "../Globals.h"
+
+struct WaveguideLanes
+{
+	static constexpr int LANES = globals::MAX_POLYPHONY;
+
+	double* tube[LANES] = {}; // delay line of each lane, owned by the processor
+	alignas(64) double readPos[LANES] = {}; // fractional read position
+	alignas(64) double y1[LANES] = {}; // radius lowpass state
+	alignas(64) double radius[LANES] = {};
+	alignas(64) double gain[LANES] = {}; // tube decay, negative for closed tubes
+	alignas(64) int writePos[LANES] = {};
+	alignas(64) int length[LANES] = {}; // power of two tube length
+	bool wrapped[LANES] = {}; // the write position went around the tube since the last clear
+};
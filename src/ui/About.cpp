@@ -1,4 +1,5 @@
 #include "About.h"
+#include "../dsp/Kernels.h"
 
 void About::mouseDown(const juce::MouseEvent& e) 
 {
@@ -30,6 +31,9 @@ void About::paint(Graphics& g)
 	g.drawText("  Depending on the DAW create an audio routing into the synth.", bounds.removeFromTop(22), Justification::centredLeft);
 	g.drawText("  Play the audio and play notes, the sound should excite the resonators.", bounds.removeFromTop(22), Justification::centredLeft);
 	g.drawText("  Check the github link for more details.", bounds.removeFromTop(22), Justification::centredLeft);
+	bounds.removeFromTop(22);
+	g.setColour(Colours::grey);
+	g.drawText(std::string("DSP kernels: ") + Kernels::get().name, bounds.removeFromTop(22), Justification::centredLeft);
 
 };
 
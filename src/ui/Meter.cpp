@@ -13,20 +13,44 @@ Meter::~Meter()
 
 void Meter::timerCallback()
 {
+	drainLevels();
 	repaint();
 }
 
+// reads the levels of all blocks processed since the last refresh
+// rms is integrated over rmsTime and peaks fall over peakRelease, in audio time not refresh time
+void Meter::drainLevels()
+{
+	auto srate = fmax(1.0, audioProcessor.getSampleRate());
+	MeterLevels levels;
+	while (audioProcessor.meterLevels.pop(levels)) {
+		auto rmsCoef = 1.0 - exp(-levels.numSamples / (srate * rmsTime));
+		auto peakCoef = exp(-levels.numSamples / (srate * peakRelease));
+		rmsL += ((double)levels.rmsL * levels.rmsL - rmsL) * rmsCoef;
+		rmsR += ((double)levels.rmsR * levels.rmsR - rmsR) * rmsCoef;
+		peakL = fmax((double)levels.peakL, peakL * peakCoef);
+		peakR = fmax((double)levels.peakR, peakR * peakCoef);
+	}
+}
+
 void Meter::paint(Graphics& g)
 {
 	(void)g;
+	auto isDark = audioProcessor.darkTheme;
+	setBulbs(bulbsL, sqrt(rmsL), peakL, isDark);
+	setBulbs(bulbsR, sqrt(rmsR), peakR, isDark);
+}
+
+void Meter::setBulbs(std::vector<std::unique_ptr<Bulb>>& bulbs, double rmsValue, double peak, bool isDark)
+{
 	// there is a limiter that prevents high volumes so rms is compared with 0.8 to light all bulbs
 	// other gimmicks gimmicks like pow(0.25) and (totalBulbs + 1) kinda makes the meter decent
-	// but still totally inaccurate
-	auto const rms = pow(fmin(1.0f, audioProcessor.rmsValue.load(std::memory_order_acquire)), 0.25f);
-	auto isDark = audioProcessor.darkTheme;
-	for (auto i = 0; i < totalBulbs; i++) {
+	// the top bulb also lights when the peak is near full scale
+	auto const rms = pow(fmin(1.0, rmsValue), 0.25);
+	for (auto i = 0; i < (int)bulbs.size(); i++) {
 		bulbs[i]->isDark = isDark;
-		bulbs[i]->setOn(rms >= static_cast<float>(i + 1) / (totalBulbs + 1) || rms >= 0.8f);
+		bulbs[i]->setOn(rms >= static_cast<double>(i + 1) / (totalBulbs + 1) || rms >= 0.8
+			|| (i == totalBulbs - 1 && peak >= 0.98));
 	}
 }
 
@@ -37,15 +61,23 @@ void Meter::resized()
 	gradient.addColour(0.5, Colours::yellow);
 
 	const auto bulbHeight = getLocalBounds().getHeight() / totalBulbs;
-	auto bulbBounds = getLocalBounds();
-	bulbs.clear();
+	auto boundsL = getLocalBounds();
+	auto boundsR = boundsL.removeFromRight(boundsL.getWidth() / 2);
+	bulbsL.clear();
+	bulbsR.clear();
 	for (auto i = 0; i < totalBulbs; i++) {
-		auto bulb = std::make_unique<Bulb>();
-		bulb->colour = gradient.getColourAtPosition(static_cast<double>(i) / (totalBulbs - 1));
-		addAndMakeVisible(bulb.get());
-		bulb->setBounds(bulbBounds.removeFromBottom(bulbHeight));
-		bulbs.push_back(std::move(bulb));
-	}			
+		auto colour = gradient.getColourAtPosition(static_cast<double>(i) / (totalBulbs - 1));
+		auto bulbL = std::make_unique<Bulb>();
+		auto bulbR = std::make_unique<Bulb>();
+		bulbL->colour = colour;
+		bulbR->colour = colour;
+		addAndMakeVisible(bulbL.get());
+		addAndMakeVisible(bulbR.get());
+		bulbL->setBounds(boundsL.removeFromBottom(bulbHeight));
+		bulbR->setBounds(boundsR.removeFromBottom(bulbHeight));
+		bulbsL.push_back(std::move(bulbL));
+		bulbsR.push_back(std::move(bulbR));
+	}
 }
 
 // =============================================================
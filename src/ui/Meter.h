@@ -27,7 +27,17 @@ public:
     void resized() override;
 
 private:
-    std::vector<std::unique_ptr<Bulb>> bulbs;
+    std::vector<std::unique_ptr<Bulb>> bulbsL;
+    std::vector<std::unique_ptr<Bulb>> bulbsR;
     const int totalBulbs = 4;
+    const double rmsTime = 0.3; // rms integration time in seconds
+    const double peakRelease = 1.5; // peak hold fall time in seconds
+    double rmsL = 0.0; // mean square with ballistics
+    double rmsR = 0.0;
+    double peakL = 0.0;
+    double peakR = 0.0;
     RipplerXAudioProcessor& audioProcessor;
+
+    void drainLevels();
+    void setBulbs(std::vector<std::unique_ptr<Bulb>>& bulbs, double rms, double peak, bool isDark);
 };
\ No newline at end of file